@@ -1,5 +1,5 @@
 /* ------------------------------ Imports ----------------------------- */
-import React, { useCallback, useEffect } from 'react';
+import React, { memo, useCallback, useEffect } from 'react';
 import {
   View,
   Text,
@@ -10,7 +10,9 @@ import {
   ActivityIndicator,
 } from 'react-native';
 import { Device } from 'react-native-ble-plx';
-import { useOtaStore } from '~/stores/otaStore';
+import { useShallow } from 'zustand/react/shallow';
+import { ScanResult, useOtaStore } from '~/stores/otaStore';
+import { OtaStats } from '~/stores/otaStats';
 
 /* ------------------------- Helper Components -------------------------- */
 const ProgressBar = ({ progress }: { progress: number }) => {
@@ -22,29 +24,70 @@ const ProgressBar = ({ progress }: { progress: number }) => {
   );
 };
 
-/* ------------------------------ Component ----------------------------- */
-const ESPOTA = () => {
-  
-  const {
-    device, 
-    isScanning,
-    foundDevices,
-    isUpdating,
-    progress,
+const formatEta = (sec: number | null) => {
+  if (sec === null || !isFinite(sec)) return '--:--';
+  const s = Math.round(sec);
+  return `${Math.floor(s / 60)}:${String(s % 60).padStart(2, '0')}`;
+};
 
-    startScan,
-    stopScan,
-    connectDevice, 
-    disconnectDevice, 
-    otaUpdate,
-    loadFirmware,
-  } = useOtaStore();
+const StatsRow = ({ label, value }: { label: string; value: string }) => (
+  <View style={styles.statsRow}>
+    <Text style={styles.statsLabel}>{label}</Text>
+    <Text style={styles.statsValue}>{value}</Text>
+  </View>
+);
 
-  useEffect(() => {
-    return () => {
-      stopScan();
-    };
-  }, [stopScan]);
+const OtaStatsPanel = ({ stats }: { stats: OtaStats }) => (
+  <View style={styles.statsContainer}>
+    <StatsRow
+      label="Throughput"
+      value={`${stats.instKBps.toFixed(1)} KB/s (avg ${stats.avgKBps.toFixed(1)})`}
+    />
+    <StatsRow label="ETA" value={formatEta(stats.etaSec)} />
+    <StatsRow
+      label="Transferred"
+      value={`${(stats.confirmedBytes / 1024).toFixed(0)} / ${(stats.totalBytes / 1024).toFixed(0)} KB`}
+    />
+    <StatsRow label="In flight" value={`${(stats.bytesInFlight / 1024).toFixed(1)} KB`} />
+    <StatsRow label="Retransmits" value={String(stats.retransmits)} />
+    <StatsRow
+      label="Link"
+      value={
+        `MTU ${stats.link.mtu}, chunk ${stats.link.chunkSize}, window ${stats.link.window}` +
+        (stats.link.priority ? `, ${stats.link.priority} priority requested` : '') +
+        (stats.link.granted ? `, ${stats.link.granted.intervalMs} ms ${stats.link.granted.txPhy}` : '')
+      }
+    />
+  </View>
+);
+
+/* ------------------------- Screen Sections ---------------------------- */
+// Each section subscribes only to the store slices it renders, so the
+// throttled progress/stats updates re-render OtaProgress and nothing else.
+
+const DeviceRow = memo(({ item, onPress }: { item: ScanResult; onPress: (d: Device) => void }) => (
+  <TouchableOpacity style={styles.deviceRow} onPress={() => onPress(item.device)}>
+    <Text style={styles.deviceText}>
+      {item.device.localName || item.device.name || 'Unknown Device'}
+    </Text>
+    <Text style={styles.deviceDetailText}>
+      {item.rssi === null ? item.device.id : `${item.device.id}  ·  ${item.rssi} dBm`}
+    </Text>
+  </TouchableOpacity>
+));
+
+const ScanSection = () => {
+  const isScanning = useOtaStore(s => s.isScanning);
+  const foundDevices = useOtaStore(s => s.foundDevices);
+  const lastTracePath = useOtaStore(s => s.lastTracePath);
+  const { startScan, stopScan, connectDevice, shareLastTrace } = useOtaStore(
+    useShallow(s => ({
+      startScan: s.startScan,
+      stopScan: s.stopScan,
+      connectDevice: s.connectDevice,
+      shareLastTrace: s.shareLastTrace,
+    })),
+  );
 
   const connect = useCallback(
     async (d: Device) => {
@@ -57,12 +100,76 @@ const ESPOTA = () => {
     [connectDevice],
   );
 
+  const renderDeviceItem = useCallback(
+    ({ item }: { item: ScanResult }) => <DeviceRow item={item} onPress={connect} />,
+    [connect],
+  );
+
+  return (
+    <>
+      <View style={styles.scanButtonContainer}>
+        <Button
+          title={isScanning ? 'Scanning...' : 'Scan for Devices'}
+          onPress={isScanning ? stopScan : startScan}
+        />
+      </View>
+
+      {lastTracePath && !isScanning && (
+        <View style={styles.scanButtonContainer}>
+          <Button title="Share Last OTA Trace" onPress={shareLastTrace} />
+        </View>
+      )}
+
+      {isScanning && <ActivityIndicator size="large" style={styles.scanner} />}
+
+      <FlatList
+        data={foundDevices}
+        keyExtractor={r => r.device.id}
+        renderItem={renderDeviceItem}
+        ListEmptyComponent={
+          !isScanning ? (
+            <View style={styles.emptyListContainer}>
+              <Text style={styles.emptyListText}>No OTA devices found.</Text>
+              <Text style={styles.emptyListSubText}>Press "Scan" to search.</Text>
+            </View>
+          ) : null
+        }
+      />
+    </>
+  );
+};
+
+const OtaProgress = () => {
+  const progress = useOtaStore(s => s.progress);
+  const stats = useOtaStore(s => s.stats);
+  return (
+    <>
+      <ProgressBar progress={progress} />
+      {stats && <OtaStatsPanel stats={stats} />}
+    </>
+  );
+};
+
+const ConnectedSection = () => {
+  const transport = useOtaStore(s => s.transport);
+  const isUpdating = useOtaStore(s => s.isUpdating);
+  const deviceApp = useOtaStore(s => s.deviceApp);
+  const deviceBoot = useOtaStore(s => s.deviceBoot);
+  const lastOutcome = useOtaStore(s => s.lastOutcome);
+  const { disconnectDevice, otaUpdate, loadFirmware } = useOtaStore(
+    useShallow(s => ({
+      disconnectDevice: s.disconnectDevice,
+      otaUpdate: s.otaUpdate,
+      loadFirmware: s.loadFirmware,
+    })),
+  );
+
   const disconnect = useCallback(() => {
     disconnectDevice();
   }, [disconnectDevice]);
 
   const startOta = useCallback(async () => {
-    if (!device || isUpdating) return;
+    if (useOtaStore.getState().isUpdating) return;
 
     try {
       const b64 = await loadFirmware();
@@ -70,77 +177,73 @@ const ESPOTA = () => {
     } catch (e) {
       console.error('OTA failed:', e);
     }
-  }, [device, isUpdating, otaUpdate, loadFirmware]);
+  }, [otaUpdate, loadFirmware]);
 
-  const renderDeviceItem = ({ item }: { item: Device }) => (
-    <TouchableOpacity style={styles.deviceRow} onPress={() => connect(item)}>
-      <Text style={styles.deviceText}>
-        {item.localName || item.name || 'Unknown Device'}
-      </Text>
-      <Text style={styles.deviceDetailText}>{item.id}</Text>
-    </TouchableOpacity>
-  );
+  if (!transport) return null;
 
   return (
-    <View style={styles.container}>
-      <Text style={styles.title}>ESP32 OTA Update</Text>
-
-      {/* UI for when no device is connected */}
-      {!device ? (
-        <>
-          <View style={styles.scanButtonContainer}>
-            <Button
-              title={isScanning ? 'Scanning...' : 'Scan for Devices'}
-              onPress={isScanning ? stopScan : startScan}
-            />
+    <>
+      <View style={styles.connectedDeviceCard}>
+          <Text style={styles.connectedTitle}>Connected Device</Text>
+          <Text style={styles.connectedDeviceName}>
+            {transport.name}
+          </Text>
+          <Text style={styles.connectedDeviceId}>
+            {transport.simulated ? `${transport.id} (simulated)` : transport.id}
+          </Text>
+          {deviceApp && (
+            <Text style={styles.deviceAppText}>
+              {`${deviceApp.projectName} ${deviceApp.version}  ·  ${deviceApp.date} ${deviceApp.time}`}
+            </Text>
+          )}
+          {deviceBoot?.milestonesMs.firstAction !== undefined && (
+            <Text style={styles.deviceAppText}>
+              {`${deviceBoot.afterUpdate ? 'Booted after update' : 'Booted'} in ${deviceBoot.milestonesMs.firstAction.toFixed(0)} ms`}
+            </Text>
+          )}
+          <View style={styles.disconnectButton}>
+            <Button title="Disconnect" onPress={disconnect} color="#FF3B30" />
           </View>
+      </View>
 
-          {isScanning && <ActivityIndicator size="large" style={styles.scanner} />}
-
-          <FlatList
-            data={foundDevices}
-            keyExtractor={d => d.id}
-            renderItem={renderDeviceItem}
-            ListEmptyComponent={
-              !isScanning ? (
-                <View style={styles.emptyListContainer}>
-                  <Text style={styles.emptyListText}>No OTA devices found.</Text>
-                  <Text style={styles.emptyListSubText}>Press "Scan" to search.</Text>
-                </View>
-              ) : null
-            }
+      <View style={styles.otaSection}>
+        <Text style={styles.otaTitle}>Firmware Update</Text>
+        {isUpdating ? (
+          // Show the progress bar and link stats while updating
+          <OtaProgress />
+        ) : (
+          // Show the start button when not updating
+          <Button
+            title={'Start OTA Update'}
+            onPress={startOta}
+            disabled={isUpdating}
           />
-        </>
-      ) : (
-        /* UI for when a device is connected */
-        <>
-          <View style={styles.connectedDeviceCard}>
-              <Text style={styles.connectedTitle}>Connected Device</Text>
-              <Text style={styles.connectedDeviceName}>
-                {device.localName || device.name}
-              </Text>
-              <Text style={styles.connectedDeviceId}>{device.id}</Text>
-              <View style={styles.disconnectButton}>
-                <Button title="Disconnect" onPress={disconnect} color="#FF3B30" />
-              </View>
-          </View>
+        )}
+        {!isUpdating && lastOutcome === 'upToDate' && (
+          <Text style={styles.otaNote}>Device already runs this firmware</Text>
+        )}
+      </View>
+    </>
+  );
+};
 
-          <View style={styles.otaSection}>
-            <Text style={styles.otaTitle}>Firmware Update</Text>
-            {isUpdating ? (
-              // Show the progress bar while updating
-              <ProgressBar progress={progress} />
-            ) : (
-              // Show the start button when not updating
-              <Button
-                title={'Start OTA Update'}
-                onPress={startOta}
-                disabled={isUpdating}
-              />
-            )}
-          </View>
-        </>
-      )}
+/* ------------------------------ Component ----------------------------- */
+const ESPOTA = () => {
+  const isConnected = useOtaStore(s => s.transport !== null);
+  const stopScan = useOtaStore(s => s.stopScan);
+
+  useEffect(() => {
+    return () => {
+      stopScan();
+    };
+  }, [stopScan]);
+
+  return (
+    <View style={styles.container}>
+      <Text style={styles.title}>ESP32 OTA Update</Text>
+
+      {/* UI for when no device is connected / when a device is connected */}
+      {!isConnected ? <ScanSection /> : <ConnectedSection />}
     </View>
   );
 };
@@ -232,6 +335,12 @@ const styles = StyleSheet.create({
       color: '#3c3c43',
       marginBottom: 20,
   },
+  deviceAppText: {
+    fontSize: 13,
+    color: '#8e8e93',
+    marginTop: -14,
+    marginBottom: 20,
+  },
   disconnectButton: {
       width: '60%',
   },
@@ -253,6 +362,12 @@ const styles = StyleSheet.create({
     textAlign: 'center',
     marginBottom: 20,
   },
+  otaNote: {
+    fontSize: 14,
+    color: '#34C759',
+    textAlign: 'center',
+    marginTop: 12,
+  },
   // Progress Bar Styles
   progressBarContainer: {
     height: 30,
@@ -276,4 +391,23 @@ const styles = StyleSheet.create({
     textShadowOffset: {width: 0, height: 1},
     textShadowRadius: 2,
   },
+  // Transfer Stats Styles
+  statsContainer: {
+    marginTop: 16,
+  },
+  statsRow: {
+    flexDirection: 'row',
+    justifyContent: 'space-between',
+    paddingVertical: 4,
+  },
+  statsLabel: {
+    fontSize: 14,
+    color: '#8e8e93',
+  },
+  statsValue: {
+    fontSize: 14,
+    fontWeight: '600',
+    color: '#1c1c1e',
+    fontVariant: ['tabular-nums'],
+  },
 });
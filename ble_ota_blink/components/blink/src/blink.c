@@ -5,6 +5,7 @@
 #include "esp_log.h"
 #include "led_strip.h"
 #include "blink.h"
+#include "ota_boot.h"
 
 static const char *TAG = "LED_BLINK";
 static uint8_t s_led_state = 0; // LED state variable
@@ -37,6 +38,7 @@ static void blink_led(void)
     } else {
         led_strip_clear(led_strip);
     }
+    ota_boot_mark(OTA_BOOT_FIRST_ACTION);
 }
 
 void blink_task(void *pvParameter) {
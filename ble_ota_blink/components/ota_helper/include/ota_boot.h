@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+// Boot profile (OTA_HELPER_BOOT_PROFILE): microseconds since reset at each
+// boot phase, from the bootloader to the application's first visible action,
+// so the downtime an update costs can be measured and compared between
+// configurations. Logged once the first action is marked and readable on
+// the control service (0x8034).
+typedef enum {
+    OTA_BOOT_BOOTLOADER,        // bootloader entered (bootloader_components hook)
+    OTA_BOOT_IMAGE_LOAD,        // bootloader initialized, app image selection and load begin
+    OTA_BOOT_APP_START,         // app image running, before app_main
+    OTA_BOOT_APP_MAIN,
+    OTA_BOOT_NVS,               // nvs_flash_init done
+    OTA_BOOT_APP_TASKS,         // application tasks created
+    OTA_BOOT_BLE,               // BLE OTA brought up
+    OTA_BOOT_FIRST_ACTION,      // first thing a user sees, e.g. the first blink
+    OTA_BOOT_MILESTONES,
+} ota_boot_milestone_t;
+
+// What the bootloader hooks leave in the custom RTC retain memory
+#define OTA_BOOT_RTC_MAGIC                  0x4f544142
+
+typedef struct {
+    uint32_t magic;
+    uint32_t bootloader_us;
+    uint32_t image_load_us;
+} ota_boot_rtc_t;
+
+#if CONFIG_OTA_HELPER_BOOT_PROFILE
+// Stamp a milestone; only the first call per boot counts.
+void ota_boot_mark(ota_boot_milestone_t m);
+
+// Flag the next boot as the one after an update, call right before restarting.
+void ota_boot_note_update(void);
+
+// Serialize the profile for the control service:
+//   [version 1][flags: bit0 after update, bit1 bootloader stamps][reset reason]
+//   [n][n x u32 us since reset, little endian, 0xffffffff = not reached]
+// Returns the bytes written, 0 if `cap` is too small.
+size_t ota_boot_export(uint8_t *buf, size_t cap);
+#else
+static inline void ota_boot_mark(ota_boot_milestone_t m) { (void)m; }
+static inline void ota_boot_note_update(void) {}
+static inline size_t ota_boot_export(uint8_t *buf, size_t cap) { (void)buf; (void)cap; return 0; }
+#endif
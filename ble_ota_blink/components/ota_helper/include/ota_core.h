@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+// Transport-independent half of ota_helper: the sector queue, the ota_task
+// state machine, progress and the flash writer. It builds for the linux
+// target too; transports only feed bytes and answer these hooks.
+typedef struct {
+    // image bytes the transport delivers in this session
+    uint32_t (*fw_length)(void);
+    // 0..100, 100 only once every sector is in flash
+    void (*progress)(uint8_t percent);
+    // optional sector diff plan: full image length (0 = no plan) and the
+    // sectors taken from the running slot instead of the transport
+    uint32_t (*plan_image_len)(void);
+    bool (*sector_unchanged)(uint16_t sector);
+    // image written and boot partition set (ESP_OK), or the session failed
+    void (*finished)(esp_err_t err);
+} ota_core_hooks_t;
+
+// Set up the core; nothing is allocated yet. A `ringbuf_size` above 8 KB that
+// cannot be had when the session starts falls back to 8 KB. `hooks` must
+// outlive the core.
+bool ota_core_init(uint32_t ringbuf_size, const ota_core_hooks_t *hooks);
+
+// Allocate the sector queue and start ota_task; it reads fw_length() right
+// away, so call once the length is known.
+bool ota_core_start(void);
+bool ota_core_started(void);
+
+// Queue image bytes for ota_task, waiting up to `wait` for room.
+bool ota_core_write(const uint8_t *data, size_t len, TickType_t wait);
+
+// End the session from a transport task without blocking it: later writes
+// are refused and ota_task reports finished() with an error once it gets
+// round to its next receive.
+void ota_core_abort(void);
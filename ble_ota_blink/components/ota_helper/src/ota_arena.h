@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// One allocation per OTA session for everything ota_core needs while a
+// transfer runs (sector queue, semaphore, copy buffer), carved out with a
+// bump allocator and released in one call when the session ends. Outside a
+// session it holds no memory.
+
+// Allocate `size` bytes, in PSRAM with OTA_HELPER_ARENA_SPIRAM when there is
+// room there, in internal RAM otherwise. Arenas above OTA_ARENA_INTERNAL_MAX
+// are PSRAM only in that case: internal RAM is not taken for a deep queue.
+#define OTA_ARENA_INTERNAL_MAX              (16 * 1024)
+
+bool ota_arena_create(size_t size);
+
+// `len` bytes from the arena, 8-byte aligned; NULL once it is exhausted.
+void *ota_arena_alloc(size_t len);
+
+// Bytes an arena of `len` allocations needs for them, alignment included.
+size_t ota_arena_footprint(size_t len);
+
+// Log what the session used and free the arena.
+void ota_arena_destroy(void);
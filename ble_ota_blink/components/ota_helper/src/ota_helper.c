@@ -4,24 +4,42 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/ringbuf.h"
-#include "freertos/semphr.h"
+#include "freertos/timers.h"
 
 #include "ota_helper.h"
+#include "ota_ctrl.h"
+#include "ota_relay.h"
+#include "ota_bcast.h"
+#include "ota_stream.h"
+#include "ota_core.h"
+#include "ota_boot.h"
 #include "ble_ota.h"
 #include "esp_log.h"
-#include "esp_ota_ops.h"
+#include "esp_system.h"
 #include "esp_bt.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "driver/gpio.h"
+#include "host/ble_hs.h"
+#include "host/ble_gap.h"
 
 static const char *TAG = "OTA_HELPER";
 
-#define OTA_RINGBUF_SIZE                    8192
-#define OTA_TASK_SIZE                       8192
+#define OTA_RINGBUF_SIZE                    (CONFIG_OTA_HELPER_QUEUE_SIZE_KB * 1024)
+#define OTA_BRINGUP_TASK_SIZE               4096
+// RECV_FW has no busy ack: ble_ota has already moved on to the next sector
+// when the callback runs. The callback runs on the NimBLE host task, so it
+// only waits briefly for room and otherwise ends the session via ota_task.
+#define OTA_RECV_FW_QUEUE_WAIT_MS           20
+#define OTA_NVS_NAMESPACE                   "ota_helper"
+#define OTA_NVS_BRINGUP_KEY                 "bringup"
+#define OTA_TRIGGER_GPIO                    (CONFIG_OTA_HELPER_BRINGUP_TRIGGER && CONFIG_OTA_HELPER_TRIGGER_GPIO >= 0)
 
-esp_ota_handle_t out_handle      = 0;
-SemaphoreHandle_t notify_sem     = NULL;
-static RingbufHandle_t s_ringbuf = NULL;
-static bool is_ota_started       = false;
+static uint32_t s_stream_len     = 0;   // image length when fed by ota_stream_*, not ble_ota
+static uint16_t s_phone_conn     = BLE_HS_CONN_HANDLE_NONE; // latest link we are the peripheral of
+static struct ble_gap_event_listener s_gap_listener;
+static bool s_bringup_started    = false;
+static portMUX_TYPE s_bringup_lock = portMUX_INITIALIZER_UNLOCKED;
 
 void 
 restart_ota_process(void) {
@@ -30,26 +48,10 @@ restart_ota_process(void) {
     esp_restart();
 }
 
-bool
-ble_ota_ringbuf_init(uint32_t ringbuf_size)
-{
-    s_ringbuf = xRingbufferCreate(ringbuf_size, RINGBUF_TYPE_BYTEBUF);
-    if (!s_ringbuf) {
-        return false;
-    }
-    return true;
-}
-
 size_t
-write_to_ringbuf(const uint8_t *data, size_t size)
+write_to_ringbuf(const uint8_t *data, size_t size, TickType_t wait)
 {
-    if (!s_ringbuf) {
-        ESP_LOGE(TAG, "Ring buffer not initialized");
-        return 0;
-    }
-
-    BaseType_t done = xRingbufferSend(s_ringbuf, (void *)data, size, 0);
-    if (done) {
+    if (ota_core_write(data, size, wait)) {
         return size;
     } else {
         ESP_LOGE(TAG, "Failed to write to ring buffer");
@@ -57,165 +59,210 @@ write_to_ringbuf(const uint8_t *data, size_t size)
     }
 }
 
-void
-ota_task(void *arg)
+/* ------------------------------ link parameters ---------------------------------- */
+// A short interval and the 2M PHY only for the length of a BLE session: asked
+// for when its first sector arrives (right after the start command) and given
+// back when it ends, so an idle link does not keep the radio busy.
+static void
+link_request(bool fast)
 {
-    esp_partition_t *partition = NULL;
-    const esp_partition_t *next_partition = NULL;
-    uint32_t recv_len = 0;
-    uint8_t *data = NULL;
-    size_t item_size = 0;
-    esp_err_t err;
+    uint16_t conn_handle = s_phone_conn;
 
-    ESP_LOGI(TAG, "ota_task start");
-
-    notify_sem = xSemaphoreCreateCounting(100, 0);
-    if (!notify_sem) {
-        ESP_LOGE(TAG, "Failed to create notify semaphore");
-        goto OTA_ERROR;
+    if (conn_handle == BLE_HS_CONN_HANDLE_NONE) {
+        return;
     }
-    xSemaphoreGive(notify_sem);
-
-    partition = (esp_partition_t *)esp_ota_get_running_partition();
-    if (!partition) {
-        ESP_LOGE(TAG, "get running partition failed!");
-        goto OTA_ERROR;
+#if CONFIG_OTA_HELPER_FAST_CONN_PARAMS
+    struct ble_gap_upd_params params = {
+        .itvl_min = fast ? CONFIG_OTA_HELPER_CONN_ITVL_MIN : BLE_GAP_INITIAL_CONN_ITVL_MIN,
+        .itvl_max = fast ? CONFIG_OTA_HELPER_CONN_ITVL_MAX : BLE_GAP_INITIAL_CONN_ITVL_MAX,
+        .latency = 0,
+        .supervision_timeout = CONFIG_OTA_HELPER_SUPERVISION_TIMEOUT,
+    };
+    int rc = ble_gap_update_params(conn_handle, &params);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "conn param update request failed: %d", rc);
     }
-
-    // rollback -> valid state 전환
-    esp_ota_img_states_t ota_state;
-    if (esp_ota_get_state_partition(partition, &ota_state) == ESP_OK) {
-        if (ota_state == ESP_OTA_IMG_PENDING_VERIFY) {
-            ESP_ERROR_CHECK(esp_ota_mark_app_valid_cancel_rollback());
-            ESP_LOGI(TAG, "Marked running image as valid");
-        }
-    } else {
-        ESP_LOGE(TAG, "Failed to get OTA state for running partition!");
-        goto OTA_ERROR;
-    }
-    
-    if (partition->type != ESP_PARTITION_TYPE_APP) {
-        ESP_LOGE(TAG, "running partition is not app type!");
-        goto OTA_ERROR;
-    }
-    if (partition->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0) {
-        next_partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
-    } else if (partition->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_1) {
-        next_partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-    } else {
-        ESP_LOGE(TAG, "running partition subtype is not OTA subtype!");
-        goto OTA_ERROR;
-    }
-    if (!next_partition) {
-        ESP_LOGE(TAG, "valid OTA partition not found!");
-        goto OTA_ERROR;
+#endif
+#if CONFIG_OTA_HELPER_PREFER_2M_PHY
+    uint8_t phy_mask = fast ? BLE_GAP_LE_PHY_2M_MASK : BLE_GAP_LE_PHY_ANY_MASK;
+    if (ble_gap_set_prefered_le_phy(conn_handle, phy_mask, phy_mask, BLE_GAP_LE_PHY_CODED_ANY) != 0) {
+        ESP_LOGW(TAG, "PHY request failed");
     }
+#endif
+}
 
-    if (esp_ota_begin(next_partition, OTA_SIZE_UNKNOWN, &out_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin failed!");
-        goto OTA_ERROR;
-    }
+/* ------------------------------ ota_core hooks ----------------------------------- */
+static uint32_t
+glue_fw_length(void)
+{
+    return s_stream_len ? s_stream_len : esp_ble_ota_get_fw_length();
+}
+
+static void
+glue_progress(uint8_t percent)
+{
+    esp_ble_ota_send_progress_report(percent);
+}
+
+#if CONFIG_OTA_HELPER_SECTOR_DIFF
+// a stream always carries the whole image
+static uint32_t
+glue_plan_image_len(void)
+{
+    return !s_stream_len && ota_ctrl_plan_active() ? ota_ctrl_plan_image_len() : 0;
+}
+#endif
 
-    // task를 늦게 등록해서 fw_length에 이미 길이 값이 설정
-    uint32_t ota_total_len = esp_ble_ota_get_fw_length();
-    ESP_LOGI(TAG, "OTA total length: %u bytes", ota_total_len);
-    if (ota_total_len <= 0) {
-        ESP_LOGE(TAG, "OTA total length is zero, aborting OTA process.");
-        goto OTA_ERROR;
+static void
+glue_finished(esp_err_t err)
+{
+    link_request(false);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "OTA successful, rebooting...");
+        vTaskDelay(pdMS_TO_TICKS(2000));
+        ota_boot_note_update();
+        esp_restart();
     }
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    restart_ota_process();
+}
 
-    /*deal with all receive packet*/
-    for (;;) {
-        // ota task will block here until data is available in the ring buffer (4KB chunk)
-        // max delay set to 10 seconds
-        data = (uint8_t *)xRingbufferReceive(s_ringbuf, &item_size, (TickType_t)pdMS_TO_TICKS(10000));
-        // timeout occurred
-        if (!data) {
-            ESP_LOGE(TAG, "Timeout waiting for data in ring buffer");
-            goto OTA_ERROR;
-        }
+static const ota_core_hooks_t s_core_hooks = {
+    .fw_length = glue_fw_length,
+    .progress = glue_progress,
+#if CONFIG_OTA_HELPER_SECTOR_DIFF
+    .plan_image_len = glue_plan_image_len,
+    .sector_unchanged = ota_ctrl_sector_unchanged,
+#endif
+    .finished = glue_finished,
+};
 
-        // take the semaphore (timeout 10 seconds)
-        if (xSemaphoreTake(notify_sem, pdMS_TO_TICKS(10000)) != pdTRUE) {
-            vRingbufferReturnItem(s_ringbuf, (void *)data);
-            ESP_LOGE(TAG, "Failed to take semaphore for OTA operation");
-            goto OTA_ERROR;
+static int
+ota_gap_event(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_CONNECT: {
+        struct ble_gap_conn_desc desc;
+        // relay links are ours as central; the phone is the one we are peripheral of
+        if (event->connect.status == 0 && ble_gap_conn_find(event->connect.conn_handle, &desc) == 0 &&
+            desc.role == BLE_GAP_ROLE_SLAVE) {
+            s_phone_conn = event->connect.conn_handle;
+        }
+        break;
+    }
+    case BLE_GAP_EVENT_CONN_UPDATE: {
+        struct ble_gap_conn_desc desc;
+        if (event->conn_update.status == 0 &&
+            ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+            ESP_LOGI(TAG, "conn params: itvl=%u latency=%u timeout=%u",
+                     desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
         }
-        
-        // write data to OTA partition and return the item to the ring buffer
-        err = esp_ota_write(out_handle, data, item_size);
-        vRingbufferReturnItem(s_ringbuf, (void *)data);
-        if (err != ESP_OK) {
-            xSemaphoreGive(notify_sem);
-            ESP_LOGE(TAG, "esp_ota_write failed");
-            goto OTA_ERROR;
+        break;
+    }
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        ESP_LOGI(TAG, "phy update: status=%d tx=%u rx=%u", event->phy_updated.status,
+                 event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+        break;
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        // status 0 on a bonded reconnect means the stored keys were reused, no pairing
+        ESP_LOGI(TAG, "encryption change: status=%d", event->enc_change.status);
+        break;
+    case BLE_GAP_EVENT_DISCONNECT:
+        if (event->disconnect.conn.conn_handle == s_phone_conn) {
+            s_phone_conn = BLE_HS_CONN_HANDLE_NONE;
         }
-
-        recv_len += item_size;
-        uint8_t progress = (recv_len * 100) / ota_total_len;
-        ESP_LOGI(TAG, "recv: %u, recv_total:%"PRIu32", total:%"PRIu32"\n", item_size, recv_len, ota_total_len);
-        
-        esp_ble_ota_send_progress_report(progress);
-        ESP_LOGI(TAG, "Sent progress: %d%%", progress);
-        
-        // 전송 받은 length로 OTA 작업이 완료되었는지 확인
-        if (recv_len >= ota_total_len) {
-            xSemaphoreGive(notify_sem);
-            break;
+#if CONFIG_OTA_HELPER_CTRL_SERVICE
+        // a plan only applies to the transfer on the link that negotiated it
+        if (!ota_core_started()) {
+            ota_ctrl_link_closed(event->disconnect.conn.conn_handle);
         }
-        
-        // release the semaphore for next iteration
-        xSemaphoreGive(notify_sem);
+#endif
+        break;
+    default:
+        break;
     }
-    ESP_LOGI(TAG, "OTA flash upload success, total length: %" PRIu32, recv_len);
+    return 0;
+}
 
-    if (esp_ota_end(out_handle) != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_end failed");
-        goto OTA_ERROR;
+static bool
+start_ota_task(void)
+{
+#if CONFIG_OTA_HELPER_BCAST_RECEIVER
+    // the phone's image wins over a broadcast still in progress; both write
+    // the inactive partition, so the receiver is out of it before ota_task opens it
+    ota_bcast_receiver_stop();
+#endif
+    if (!ota_core_start()) {
+        return false;
     }
-
-    if (esp_ota_set_boot_partition(next_partition) != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed");
-        goto OTA_ERROR;
+    if (!s_stream_len) {
+        link_request(true);
     }
-
-    ESP_LOGI(TAG, "OTA successful, rebooting...");
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    esp_restart();
-
-OTA_ERROR:
-    vTaskDelay(pdMS_TO_TICKS(2000));
-    restart_ota_process();
-
-    // never reached, but just in case
-    vTaskDelete(NULL);
-    return;
+#if CONFIG_OTA_HELPER_RELAY
+    // this unit is being updated itself, its image is about to be stale
+    ota_relay_stop();
+#endif
+    return true;
 }
 
 void
 ota_recv_fw_cb(uint8_t *buf, uint32_t length)
 {   
-    if (!is_ota_started) {
-        BaseType_t task = xTaskCreate(ota_task, "ota_task", OTA_TASK_SIZE, NULL, 10, NULL);
-        if (task == pdPASS) {
-            is_ota_started = true;
-        } else {
-            ESP_LOGE(TAG, "Failed to create OTA task");
-            restart_ota_process();
-            return;
-        }
+    if (s_stream_len) {
+        ESP_LOGW(TAG, "ble_ota data ignored, image is streamed over another transport");
+        return;
+    }
+    if (!ota_core_started() && !start_ota_task()) {
+        restart_ota_process();
+        return;
+    }
+    // a sector ble_ota accepted but the queue did not would leave a gap in the
+    // image that nothing reports; end the session instead
+    if (write_to_ringbuf(buf, length, pdMS_TO_TICKS(OTA_RECV_FW_QUEUE_WAIT_MS)) != length) {
+        ota_core_abort();
     }
-    write_to_ringbuf(buf, length);
 }
 
-bool ble_ota_helper_init()
+bool
+ota_stream_begin(uint32_t fw_len)
+{
+    if (ota_core_started() || fw_len == 0) {
+        return false;
+    }
+    s_stream_len = fw_len;
+    return start_ota_task();
+}
+
+bool
+ota_stream_write(const uint8_t *data, size_t len, TickType_t wait)
+{
+    return ota_core_write(data, len, wait);
+}
+
+bool
+ota_stream_sector(const uint8_t *data, size_t len)
+{
+    if (s_stream_len) {
+        return false;
+    }
+    if (!ota_core_started() && !start_ota_task()) {
+        restart_ota_process();
+        return false;
+    }
+    // refused sectors are acked BUSY and resent by the app
+    return write_to_ringbuf(data, len, 0) == len;
+}
+
+static bool
+bringup(void)
 {
     esp_err_t ret;
 
     ESP_LOGI(TAG, "Initializing BLE OTA helper");
-    
-    if (!ble_ota_ringbuf_init(OTA_RINGBUF_SIZE)) {
-        ESP_LOGE(TAG, "%s init ringbuf fail", __func__);
+
+    // only records the queue size, the queue is allocated when a transfer starts
+    if (!ota_core_init(OTA_RINGBUF_SIZE, &s_core_hooks)) {
+        ESP_LOGE(TAG, "%s init ota_core fail", __func__);
         return false;
     }
     
@@ -227,17 +274,195 @@ bool ble_ota_helper_init()
         ESP_LOGE(TAG, "%s enable controller failed: %s\n", __func__, esp_err_to_name(ret));
         return false;
     }
+    // a failed bring-up can be retried, so the controller is released again
     ret = esp_bt_controller_enable(ESP_BT_MODE_BLE);
     if (ret) {
         ESP_LOGE(TAG, "%s enable controller failed: %s\n", __func__, esp_err_to_name(ret));
+        esp_bt_controller_deinit();
         return false;
     }
+#if CONFIG_OTA_HELPER_BLE_BONDING
+    // bond and keep the keys in NVS so a known phone reconnects without pairing.
+    // Set before esp_ble_ota_host_init(), which starts the host task and also
+    // initialises the NVS key store, so the first pairing already sees them.
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+#endif
     if (esp_ble_ota_host_init() != ESP_OK) {
         ESP_LOGE(TAG, "%s initialize ble host fail: %s\n", __func__, esp_err_to_name(ret));
+        esp_bt_controller_disable();
+        esp_bt_controller_deinit();
         return false;
     }
 
+    ble_gap_event_listener_register(&s_gap_listener, ota_gap_event, NULL);
+
+#if CONFIG_OTA_HELPER_CTRL_SERVICE
+    // not fatal: plain ble_ota transfers work without it
+    if (!ota_ctrl_init()) {
+        ESP_LOGW(TAG, "OTA control service unavailable");
+    }
+#endif
+#if CONFIG_OTA_HELPER_RELAY
+    if (!ota_relay_start()) {
+        ESP_LOGW(TAG, "OTA relay not started");
+    }
+#endif
+#if CONFIG_OTA_HELPER_BCAST_SOURCE
+    if (!ota_bcast_source_start()) {
+        ESP_LOGW(TAG, "OTA broadcast source not started");
+    }
+#endif
+#if CONFIG_OTA_HELPER_BCAST_RECEIVER
+    if (!ota_bcast_receiver_start()) {
+        ESP_LOGW(TAG, "OTA broadcast receiver not started");
+    }
+#endif
+
     // RECV_FW_CHAR callback
     esp_ble_ota_recv_fw_data_callback(ota_recv_fw_cb);
+    ESP_LOGI(TAG, "BLE OTA up %" PRId64 " ms after boot", esp_timer_get_time() / 1000);
+    ota_boot_mark(OTA_BOOT_BLE);
+    return true;
+}
+
+/* ------------------------------ bring-up ----------------------------------------- */
+static void
+bringup_task(void *arg)
+{
+#if CONFIG_OTA_HELPER_BRINGUP_DEFERRED
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_HELPER_BRINGUP_DELAY_MS));
+#endif
+    if (!bringup()) {
+        ESP_LOGE(TAG, "BLE OTA bring-up failed");
+        // a later trigger or ble_ota_helper_start() may try again
+        taskENTER_CRITICAL(&s_bringup_lock);
+        s_bringup_started = false;
+        taskEXIT_CRITICAL(&s_bringup_lock);
+    }
+    vTaskDelete(NULL);
+}
+
+bool
+ble_ota_helper_start(void)
+{
+    taskENTER_CRITICAL(&s_bringup_lock);
+    bool started = s_bringup_started;
+    s_bringup_started = true;
+    taskEXIT_CRITICAL(&s_bringup_lock);
+    if (started) {
+        return true;
+    }
+    // just above idle: the application's own tasks keep the CPU
+    if (xTaskCreate(bringup_task, "ota_bringup", OTA_BRINGUP_TASK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create bring-up task");
+        s_bringup_started = false;
+        return false;
+    }
+    return true;
+}
+
+esp_err_t
+ble_ota_helper_request_at_boot(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(nvs, OTA_NVS_BRINGUP_KEY, 1);
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    return err;
+}
+
+#if CONFIG_OTA_HELPER_BRINGUP_TRIGGER
+// one-shot: the flag is cleared as it is read
+static bool
+bringup_requested(void)
+{
+    nvs_handle_t nvs;
+    uint8_t flag = 0;
+
+    if (nvs_open(OTA_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        return false;
+    }
+    if (nvs_get_u8(nvs, OTA_NVS_BRINGUP_KEY, &flag) == ESP_OK) {
+        nvs_erase_key(nvs, OTA_NVS_BRINGUP_KEY);
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return flag != 0;
+}
+#endif
+
+#if OTA_TRIGGER_GPIO
+static void
+trigger_gpio_pressed(void *arg1, uint32_t arg2)
+{
+    gpio_intr_disable(CONFIG_OTA_HELPER_TRIGGER_GPIO);
+    ESP_LOGI(TAG, "OTA button pressed");
+    ble_ota_helper_start();
+}
+
+// the bring-up creates a task, leave that to the timer service task
+static void
+trigger_gpio_isr(void *arg)
+{
+    BaseType_t woken = pdFALSE;
+    xTimerPendFunctionCallFromISR(trigger_gpio_pressed, NULL, 0, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static esp_err_t
+trigger_gpio_arm(void)
+{
+    const gpio_config_t io = {
+        .pin_bit_mask = 1ULL << CONFIG_OTA_HELPER_TRIGGER_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    esp_err_t err = gpio_config(&io);
+    if (err == ESP_OK) {
+        // the application may have installed the ISR service already
+        err = gpio_install_isr_service(0);
+        err = err == ESP_ERR_INVALID_STATE ? ESP_OK : err;
+    }
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add(CONFIG_OTA_HELPER_TRIGGER_GPIO, trigger_gpio_isr, NULL);
+    }
+    return err;
+}
+#endif
+
+bool ble_ota_helper_init()
+{
+#if CONFIG_OTA_HELPER_BRINGUP_BOOT
+    s_bringup_started = true;
+    if (!bringup()) {
+        s_bringup_started = false;
+        return false;
+    }
+    return true;
+#elif CONFIG_OTA_HELPER_BRINGUP_DEFERRED
+    return ble_ota_helper_start();
+#else
+    if (bringup_requested()) {
+        ESP_LOGI(TAG, "BLE OTA requested at boot");
+        return ble_ota_helper_start();
+    }
+#if OTA_TRIGGER_GPIO
+    esp_err_t err = trigger_gpio_arm();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "OTA button on GPIO %d: %s", CONFIG_OTA_HELPER_TRIGGER_GPIO, esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "BLE OTA waits for GPIO %d", CONFIG_OTA_HELPER_TRIGGER_GPIO);
+#endif
     return true;
+#endif
 }
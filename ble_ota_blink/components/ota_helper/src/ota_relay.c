@@ -0,0 +1,575 @@
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_image_format.h"
+#include "host/ble_hs.h"
+#include "host/ble_gap.h"
+#include "host/ble_gatt.h"
+
+#include "ota_relay.h"
+
+static const char *TAG = "OTA_RELAY";
+
+#define RELAY_TASK_SIZE                     6144
+#define RELAY_SECTOR_SIZE                   4096
+// sector bytes per write: ATT caps a value at 512 whatever the MTU
+#define RELAY_MAX_CHUNK                     512
+#define RELAY_EVT_QUEUE_LEN                 16
+#define RELAY_SYNC_TIMEOUT_MS               5000
+#define RELAY_CONNECT_TIMEOUT_MS            5000
+#define RELAY_GATT_TIMEOUT_MS               3000
+#define RELAY_SECTOR_TIMEOUT_MS             5000
+#define RELAY_SECTOR_MAX_RETRIES            3
+#define RELAY_MAX_CANDIDATES                8
+// foreign or unreachable advertisers of UUID_OTA_ADV remembered per boot
+#define RELAY_MAX_SKIPPED                   16
+// scans in a row that handle no new unit before the relay gives up
+#define RELAY_IDLE_ROUNDS                   3
+
+// ble_ota service and characteristics, ota_helper control service
+#define UUID_OTA_ADV                        0x1811
+#define UUID_OTA_SVC                        0x8018
+#define UUID_RECV_FW_CHR                    0x8020
+#define UUID_PROGRESS_CHR                   0x8021
+#define UUID_COMMAND_CHR                    0x8022
+#define UUID_CTRL_SVC                       0x8030
+#define UUID_INFO_CHR                       0x8032
+
+typedef enum {
+    RELAY_EVT_SCAN_DONE,
+    RELAY_EVT_CONNECTED,
+    RELAY_EVT_DISCONNECTED,
+    RELAY_EVT_GATT_DONE,  // status: 0 or a BLE_HS error
+    RELAY_EVT_NOTIFY,
+} relay_evt_type_t;
+
+typedef struct {
+    relay_evt_type_t type;
+    int status;
+    uint16_t handle;
+    uint8_t len;
+    uint8_t data[20];
+} relay_evt_t;
+
+// one peer session at a time; all fields are owned by the relay task
+static struct {
+    uint16_t conn_handle;
+    uint16_t mtu;
+    uint16_t svc_start, svc_end;
+    uint16_t recv_fw, progress, command, info;
+    uint8_t progress_pct;
+    bool nack;
+    uint8_t info_buf[sizeof(esp_app_desc_t)];
+    uint16_t info_len;
+} s_peer;
+
+static QueueHandle_t s_evt_queue;
+static volatile bool s_stop;
+static uint8_t s_own_addr_type;
+static ble_addr_t s_candidates[RELAY_MAX_CANDIDATES];
+static int s_num_candidates;
+static ble_addr_t s_done[CONFIG_OTA_HELPER_RELAY_MAX_PEERS];
+static int s_num_done;
+static ble_addr_t s_skipped[RELAY_MAX_SKIPPED];
+static int s_num_skipped;
+static uint8_t *s_sector_buf;   // only while an image is pushed
+
+/* ------------------------------ helpers ------------------------------------------ */
+
+// ble_ota framing CRC: CRC16-CCITT, init 0, no final xor
+static uint16_t
+relay_crc16(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// numeric compare of dotted versions ("v1.10.2" > "v1.9"), non-digits skipped
+static int
+version_cmp(const char *a, const char *b)
+{
+    while (*a || *b) {
+        while (*a && !isdigit((unsigned char)*a)) a++;
+        while (*b && !isdigit((unsigned char)*b)) b++;
+        long na = strtol(a, (char **)&a, 10);
+        long nb = strtol(b, (char **)&b, 10);
+        if (na != nb) {
+            return na < nb ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+static bool
+addr_in(const ble_addr_t *list, int n, const ble_addr_t *addr)
+{
+    for (int i = 0; i < n; i++) {
+        if (ble_addr_cmp(&list[i], addr) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+post_evt(relay_evt_type_t type, int status)
+{
+    relay_evt_t evt = { .type = type, .status = status };
+    xQueueSend(s_evt_queue, &evt, 0);
+}
+
+// Wait for an event of `type`. Notifications arriving meanwhile update the
+// session state; a disconnect always ends the wait with BLE_HS_ENOTCONN.
+static int
+wait_evt(relay_evt_type_t type, uint32_t timeout_ms)
+{
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+    relay_evt_t evt;
+
+    for (;;) {
+        TickType_t now = xTaskGetTickCount();
+        if (now >= deadline || !xQueueReceive(s_evt_queue, &evt, deadline - now)) {
+            return BLE_HS_ETIMEOUT;
+        }
+        if (evt.type == RELAY_EVT_NOTIFY) {
+            if (evt.handle == s_peer.progress && evt.len >= 1) {
+                s_peer.progress_pct = evt.data[0];
+            } else if (evt.handle == s_peer.recv_fw && evt.len >= 4 && (evt.data[2] | evt.data[3] << 8) != 0) {
+                s_peer.nack = true;
+            }
+            if (type == RELAY_EVT_NOTIFY) {
+                return 0;
+            }
+            continue;
+        }
+        if (evt.type == RELAY_EVT_DISCONNECTED && type != RELAY_EVT_DISCONNECTED) {
+            return BLE_HS_ENOTCONN;
+        }
+        if (evt.type == type) {
+            return evt.status;
+        }
+    }
+}
+
+/* ------------------------------ GAP / GATT callbacks ----------------------------- */
+
+static int
+relay_gap_event(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_DISC: {
+        struct ble_hs_adv_fields fields;
+        if (s_num_candidates >= RELAY_MAX_CANDIDATES ||
+            ble_hs_adv_parse_fields(&fields, event->disc.data, event->disc.length_data) != 0) {
+            break;
+        }
+        for (int i = 0; i < fields.num_uuids16; i++) {
+            if (fields.uuids16[i].value == UUID_OTA_ADV &&
+                !addr_in(s_candidates, s_num_candidates, &event->disc.addr) &&
+                !addr_in(s_done, s_num_done, &event->disc.addr) &&
+                !addr_in(s_skipped, s_num_skipped, &event->disc.addr)) {
+                s_candidates[s_num_candidates++] = event->disc.addr;
+            }
+        }
+        break;
+    }
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+        post_evt(RELAY_EVT_SCAN_DONE, 0);
+        break;
+    case BLE_GAP_EVENT_CONNECT:
+        s_peer.conn_handle = event->connect.conn_handle;
+        post_evt(event->connect.status == 0 ? RELAY_EVT_CONNECTED : RELAY_EVT_DISCONNECTED,
+                 event->connect.status);
+        break;
+    case BLE_GAP_EVENT_DISCONNECT:
+        post_evt(RELAY_EVT_DISCONNECTED, event->disconnect.reason);
+        break;
+    case BLE_GAP_EVENT_NOTIFY_RX: {
+        relay_evt_t evt = { .type = RELAY_EVT_NOTIFY, .handle = event->notify_rx.attr_handle };
+        uint16_t len = 0;
+        ble_hs_mbuf_to_flat(event->notify_rx.om, evt.data, sizeof(evt.data), &len);
+        evt.len = len;
+        xQueueSend(s_evt_queue, &evt, 0);
+        break;
+    }
+    default:
+        break;
+    }
+    return 0;
+}
+
+static int
+on_mtu(uint16_t conn_handle, const struct ble_gatt_error *error, uint16_t mtu, void *arg)
+{
+    s_peer.mtu = error->status == 0 ? mtu : BLE_ATT_MTU_DFLT;
+    post_evt(RELAY_EVT_GATT_DONE, 0);
+    return 0;
+}
+
+static int
+on_disc_svc(uint16_t conn_handle, const struct ble_gatt_error *error,
+            const struct ble_gatt_svc *service, void *arg)
+{
+    if (error->status == 0) {
+        s_peer.svc_start = service->start_handle;
+        s_peer.svc_end = service->end_handle;
+    } else {
+        post_evt(RELAY_EVT_GATT_DONE, error->status == BLE_HS_EDONE && s_peer.svc_start ? 0 : error->status);
+    }
+    return 0;
+}
+
+static int
+on_disc_chr(uint16_t conn_handle, const struct ble_gatt_error *error,
+            const struct ble_gatt_chr *chr, void *arg)
+{
+    if (error->status != 0) {
+        post_evt(RELAY_EVT_GATT_DONE, error->status == BLE_HS_EDONE ? 0 : error->status);
+        return 0;
+    }
+    switch (ble_uuid_u16(&chr->uuid.u)) {
+    case UUID_RECV_FW_CHR:  s_peer.recv_fw = chr->val_handle; break;
+    case UUID_PROGRESS_CHR: s_peer.progress = chr->val_handle; break;
+    case UUID_COMMAND_CHR:  s_peer.command = chr->val_handle; break;
+    case UUID_INFO_CHR:     s_peer.info = chr->val_handle; break;
+    default: break;
+    }
+    return 0;
+}
+
+static int
+on_read_info(uint16_t conn_handle, const struct ble_gatt_error *error,
+             struct ble_gatt_attr *attr, void *arg)
+{
+    if (error->status == 0) {
+        uint16_t len = OS_MBUF_PKTLEN(attr->om);
+        if (s_peer.info_len + len <= sizeof(s_peer.info_buf)) {
+            os_mbuf_copydata(attr->om, 0, len, s_peer.info_buf + s_peer.info_len);
+            s_peer.info_len += len;
+        }
+    } else {
+        post_evt(RELAY_EVT_GATT_DONE, error->status == BLE_HS_EDONE ? 0 : error->status);
+    }
+    return 0;
+}
+
+static int
+on_write(uint16_t conn_handle, const struct ble_gatt_error *error, struct ble_gatt_attr *attr, void *arg)
+{
+    post_evt(RELAY_EVT_GATT_DONE, error->status);
+    return 0;
+}
+
+/* ------------------------------ GATT client steps -------------------------------- */
+
+static int
+discover(uint16_t svc_uuid)
+{
+    ble_uuid16_t uuid = BLE_UUID16_INIT(svc_uuid);
+    int rc;
+
+    s_peer.svc_start = s_peer.svc_end = 0;
+    rc = ble_gattc_disc_svc_by_uuid(s_peer.conn_handle, &uuid.u, on_disc_svc, NULL);
+    if (rc == 0) {
+        rc = wait_evt(RELAY_EVT_GATT_DONE, RELAY_GATT_TIMEOUT_MS);
+    }
+    if (rc == 0) {
+        rc = ble_gattc_disc_all_chrs(s_peer.conn_handle, s_peer.svc_start, s_peer.svc_end, on_disc_chr, NULL);
+    }
+    if (rc == 0) {
+        rc = wait_evt(RELAY_EVT_GATT_DONE, RELAY_GATT_TIMEOUT_MS);
+    }
+    return rc;
+}
+
+static int
+write_sync(uint16_t handle, const void *data, uint16_t len)
+{
+    int rc = ble_gattc_write_flat(s_peer.conn_handle, handle, data, len, on_write, NULL);
+    return rc == 0 ? wait_evt(RELAY_EVT_GATT_DONE, RELAY_GATT_TIMEOUT_MS) : rc;
+}
+
+// CCCD directly follows the value handle on NimBLE peripherals, ble_ota included
+static int
+subscribe(uint16_t val_handle)
+{
+    uint8_t on[2] = { 0x01, 0x00 };
+    return write_sync(val_handle + 1, on, sizeof(on));
+}
+
+bool
+ota_relay_app_newer(const esp_app_desc_t *app, const esp_app_desc_t *than)
+{
+    if (app->magic_word != ESP_APP_DESC_MAGIC_WORD || than->magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        return false;
+    }
+    if (strncmp(app->project_name, than->project_name, sizeof(app->project_name)) != 0) {
+        return false;
+    }
+    return version_cmp(app->version, than->version) > 0;
+}
+
+// true once the peer's app description was read, i.e. it runs ota_helper
+static bool
+peer_known(void)
+{
+    return s_peer.info_len >= sizeof(esp_app_desc_t);
+}
+
+// true when the peer runs this project at an older version
+static bool
+peer_needs_update(void)
+{
+    const esp_app_desc_t *own = esp_app_get_description();
+    const esp_app_desc_t *peer = (const esp_app_desc_t *)s_peer.info_buf;
+
+    if (!peer_known()) {
+        return false;
+    }
+    ESP_LOGI(TAG, "peer runs %.32s, we run %.32s", peer->version, own->version);
+    return ota_relay_app_newer(own, peer);
+}
+
+static int
+send_sector(const esp_partition_t *running, uint16_t sector, uint32_t image_len)
+{
+    uint32_t off = (uint32_t)sector * RELAY_SECTOR_SIZE;
+    size_t len = MIN(RELAY_SECTOR_SIZE, image_len - off);
+    // header and CRC trailer take 5 of the MTU - 3 write payload
+    size_t chunk = MIN(s_peer.mtu - 8, RELAY_MAX_CHUNK);
+    uint8_t packet[3 + RELAY_MAX_CHUNK + 2];
+    int rc;
+
+    if (esp_partition_read(running, off, s_sector_buf, len) != ESP_OK) {
+        return BLE_HS_EUNKNOWN;
+    }
+    uint16_t crc = relay_crc16(s_sector_buf, len);
+    size_t num_seq = (len + chunk - 1) / chunk;
+
+    for (size_t seq = 0; seq < num_seq; seq++) {
+        size_t slice = MIN(chunk, len - seq * chunk);
+        bool last = seq == num_seq - 1;
+        packet[0] = sector & 0xFF;
+        packet[1] = sector >> 8;
+        packet[2] = last ? 0xFF : seq;
+        memcpy(packet + 3, s_sector_buf + seq * chunk, slice);
+        if (last) {
+            packet[3 + slice] = crc & 0xFF;
+            packet[4 + slice] = crc >> 8;
+        }
+        rc = write_sync(s_peer.recv_fw, packet, 3 + slice + (last ? 2 : 0));
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    return 0;
+}
+
+// Full ble_ota session toward the connected peer, window 1: each sector is
+// confirmed by the peer's progress report before the next one is sent.
+static int
+push_session(void)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_partition_pos_t pos = { .offset = running->address, .size = running->size };
+    esp_image_metadata_t meta;
+    uint8_t cmd[20] = { 0x01, 0x00 };
+    int rc;
+
+    if (esp_image_get_metadata(&pos, &meta) != ESP_OK) {
+        ESP_LOGE(TAG, "cannot read running image length");
+        return BLE_HS_EUNKNOWN;
+    }
+    uint32_t image_len = meta.image_len;
+    uint16_t num_sectors = (image_len + RELAY_SECTOR_SIZE - 1) / RELAY_SECTOR_SIZE;
+
+    if ((rc = subscribe(s_peer.recv_fw)) || (rc = subscribe(s_peer.progress)) || (rc = subscribe(s_peer.command))) {
+        return rc;
+    }
+
+    memcpy(cmd + 2, &image_len, sizeof(image_len));
+    uint16_t cmd_crc = relay_crc16(cmd, 18);
+    cmd[18] = cmd_crc & 0xFF;
+    cmd[19] = cmd_crc >> 8;
+    s_peer.progress_pct = 0;
+    if ((rc = write_sync(s_peer.command, cmd, sizeof(cmd))) != 0) {
+        return rc;
+    }
+    // start ack
+    if ((rc = wait_evt(RELAY_EVT_NOTIFY, RELAY_GATT_TIMEOUT_MS)) != 0) {
+        return rc;
+    }
+    ESP_LOGI(TAG, "pushing %" PRIu32 " bytes (%u sectors), mtu %u", image_len, num_sectors, s_peer.mtu);
+
+    for (uint16_t sector = 0; sector < num_sectors && !s_stop; sector++) {
+        uint8_t expected = ((uint64_t)MIN((uint32_t)(sector + 1) * RELAY_SECTOR_SIZE, image_len) * 100) / image_len;
+        int attempt = 0;
+        for (;;) {
+            s_peer.nack = false;
+            rc = send_sector(running, sector, image_len);
+            TickType_t start = xTaskGetTickCount();
+            while (rc == 0 && s_peer.progress_pct < expected && !s_peer.nack) {
+                uint32_t waited = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+                if (waited >= RELAY_SECTOR_TIMEOUT_MS) {
+                    rc = BLE_HS_ETIMEOUT;
+                    break;
+                }
+                rc = wait_evt(RELAY_EVT_NOTIFY, RELAY_SECTOR_TIMEOUT_MS - waited);
+            }
+            if (rc == 0 && !s_peer.nack) {
+                break;
+            }
+            if (rc == BLE_HS_ENOTCONN || ++attempt > RELAY_SECTOR_MAX_RETRIES) {
+                ESP_LOGE(TAG, "sector %u failed: rc=%d nack=%d", sector, rc, s_peer.nack);
+                return rc ? rc : BLE_HS_EUNKNOWN;
+            }
+            ESP_LOGW(TAG, "sector %u retry %d", sector, attempt);
+            rc = 0;
+        }
+    }
+    return s_stop ? BLE_HS_EUNKNOWN : 0;
+}
+
+static int
+push_image(void)
+{
+    if (!(s_sector_buf = malloc(RELAY_SECTOR_SIZE))) {
+        return BLE_HS_ENOMEM;
+    }
+    int rc = push_session();
+    free(s_sector_buf);
+    s_sector_buf = NULL;
+    return rc;
+}
+
+/* ------------------------------ relay task --------------------------------------- */
+
+// Not visited again this boot: ota_helper units that were updated or are up
+// to date (they count against the per-boot limit), and, while there is room,
+// anything that failed or is not ours, such as other 0x1811 advertisers.
+static void
+relay_mark(const ble_addr_t *addr, bool handled)
+{
+    if (handled && s_num_done < CONFIG_OTA_HELPER_RELAY_MAX_PEERS) {
+        s_done[s_num_done++] = *addr;
+    } else if (!handled && s_num_skipped < RELAY_MAX_SKIPPED) {
+        s_skipped[s_num_skipped++] = *addr;
+    }
+}
+
+static void
+relay_peer(const ble_addr_t *addr)
+{
+    int rc;
+
+    memset(&s_peer, 0, sizeof(s_peer));
+    xQueueReset(s_evt_queue);
+    rc = ble_gap_connect(s_own_addr_type, addr, RELAY_CONNECT_TIMEOUT_MS, NULL, relay_gap_event, NULL);
+    if (rc != 0 || wait_evt(RELAY_EVT_CONNECTED, RELAY_CONNECT_TIMEOUT_MS + 1000) != 0) {
+        ESP_LOGW(TAG, "connect failed: %d", rc);
+        ble_gap_conn_cancel();
+        relay_mark(addr, false);
+        return;
+    }
+
+    rc = ble_gattc_exchange_mtu(s_peer.conn_handle, on_mtu, NULL);
+    if (rc == 0) rc = wait_evt(RELAY_EVT_GATT_DONE, RELAY_GATT_TIMEOUT_MS);
+    if (rc == 0) rc = discover(UUID_CTRL_SVC);
+    if (rc == 0 && s_peer.info) {
+        rc = ble_gattc_read_long(s_peer.conn_handle, s_peer.info, 0, on_read_info, NULL);
+        if (rc == 0) rc = wait_evt(RELAY_EVT_GATT_DONE, RELAY_GATT_TIMEOUT_MS);
+    }
+
+    if (rc == 0 && peer_needs_update()) {
+        rc = discover(UUID_OTA_SVC);
+        if (rc == 0 && s_peer.recv_fw && s_peer.progress && s_peer.command) {
+            rc = push_image();
+            ESP_LOGI(TAG, "relay to peer %s (rc=%d)", rc == 0 ? "done" : "failed", rc);
+        }
+    }
+    relay_mark(addr, rc == 0 && peer_known());
+    ble_gap_terminate(s_peer.conn_handle, BLE_ERR_REM_USER_CONN_TERM);
+    wait_evt(RELAY_EVT_DISCONNECTED, RELAY_GATT_TIMEOUT_MS);
+}
+
+// the relay starts from bringup(), which may run before the host has synced
+// with the controller; the identity address is only known after that
+static bool
+wait_host_sync(void)
+{
+    for (int waited = 0; !ble_hs_synced(); waited += 10) {
+        if (waited >= RELAY_SYNC_TIMEOUT_MS) {
+            ESP_LOGE(TAG, "host did not sync");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+static void
+relay_task(void *arg)
+{
+    struct ble_gap_disc_params disc = {
+        .passive = 0,
+        .filter_duplicates = 1,
+    };
+
+    // leave the phone a chance to connect first after boot
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_HELPER_RELAY_START_DELAY_MS));
+    if (!wait_host_sync() || ble_hs_id_infer_auto(0, &s_own_addr_type) != 0) {
+        ESP_LOGE(TAG, "no identity address, relay not started");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    for (int idle = 0; !s_stop && s_num_done < CONFIG_OTA_HELPER_RELAY_MAX_PEERS && idle < RELAY_IDLE_ROUNDS;) {
+        int done = s_num_done;
+        s_num_candidates = 0;
+        xQueueReset(s_evt_queue);
+        if (ble_gap_disc(s_own_addr_type, CONFIG_OTA_HELPER_RELAY_SCAN_MS, &disc, relay_gap_event, NULL) != 0 ||
+            wait_evt(RELAY_EVT_SCAN_DONE, CONFIG_OTA_HELPER_RELAY_SCAN_MS + 1000) != 0) {
+            ble_gap_disc_cancel();
+        }
+        for (int i = 0; i < s_num_candidates && !s_stop; i++) {
+            relay_peer(&s_candidates[i]);
+        }
+        idle = s_num_done > done ? 0 : idle + 1;
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_HELPER_RELAY_SCAN_MS));
+    }
+    ESP_LOGI(TAG, "relay stopped, %d peers handled, %d skipped", s_num_done, s_num_skipped);
+    vTaskDelete(NULL);
+}
+
+bool
+ota_relay_start(void)
+{
+    s_evt_queue = xQueueCreate(RELAY_EVT_QUEUE_LEN, sizeof(relay_evt_t));
+    if (!s_evt_queue) {
+        return false;
+    }
+    return xTaskCreate(relay_task, "ota_relay", RELAY_TASK_SIZE, NULL, 4, NULL) == pdPASS;
+}
+
+void
+ota_relay_stop(void)
+{
+    s_stop = true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+
+// Feed ota_task from a transport other than ble_ota (implemented in ota_helper.c).
+// The image goes through the same ring buffer, writer and verification.
+
+// Start ota_task for an image of `fw_len` bytes. False if an OTA already runs.
+bool ota_stream_begin(uint32_t fw_len);
+
+// Queue image bytes, blocking up to `wait` while the flash writer catches up.
+bool ota_stream_write(const uint8_t *data, size_t len, TickType_t wait);
+
+// A whole, already verified sector of the ble_ota session (its START command
+// set the length), received on a channel other than RECV_FW. False if it could
+// not be queued; unlike RECV_FW the sender is told and resends.
+bool ota_stream_sector(const uint8_t *data, size_t len);
@@ -0,0 +1,251 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_http_client.h"
+
+#include "ota_wifi.h"
+#include "ota_stream.h"
+
+#if CONFIG_OTA_HELPER_WIFI
+
+static const char *TAG = "OTA_WIFI";
+
+#define OTA_WIFI_TASK_SIZE                  6144
+#define OTA_WIFI_BUF_SIZE                   4096
+#define OTA_WIFI_STA_RETRIES                5
+#define OTA_WIFI_HTTP_RETRY_MS              1000
+// a flash erase burst can hold the writer for a while, TCP just backs off meanwhile
+#define OTA_WIFI_QUEUE_WAIT_MS              10000
+
+#define WIFI_UP_BIT                         BIT0   // STA got an IP / a station joined our AP
+#define WIFI_FAIL_BIT                       BIT1
+
+static ota_wifi_req_t s_req;
+static ota_wifi_ready_cb_t s_ready_cb;
+static void *s_ready_arg;
+static EventGroupHandle_t s_wifi_events;
+static esp_netif_t *s_sta_netif;
+static esp_netif_t *s_ap_netif;
+static int s_sta_retries;
+static bool s_running;
+
+static void
+wifi_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (s_sta_retries++ < OTA_WIFI_STA_RETRIES) {
+            esp_wifi_connect();
+        } else {
+            xEventGroupSetBits(s_wifi_events, WIFI_FAIL_BIT);
+        }
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        xEventGroupSetBits(s_wifi_events, WIFI_UP_BIT);
+    } else if (base == WIFI_EVENT && id == WIFI_EVENT_AP_STACONNECTED) {
+        // the image server joined; it still needs a DHCP lease, the HTTP open is retried
+        xEventGroupSetBits(s_wifi_events, WIFI_UP_BIT);
+    }
+}
+
+static esp_err_t
+wifi_bring_up(uint32_t *ip4)
+{
+    wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+    wifi_config_t cfg = { 0 };
+    esp_netif_ip_info_t ip_info;
+    esp_err_t err;
+
+    // netif, event loop and handlers survive a failed attempt, only the driver is torn down
+    if (!s_wifi_events) {
+        ESP_RETURN_ON_ERROR(esp_netif_init(), TAG, "esp_netif_init");
+        err = esp_event_loop_create_default();
+        // app_main may already have created it
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+            return err;
+        }
+        ESP_RETURN_ON_ERROR(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL), TAG, "wifi events");
+        ESP_RETURN_ON_ERROR(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL), TAG, "ip events");
+        s_wifi_events = xEventGroupCreate();
+        if (!s_wifi_events) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    xEventGroupClearBits(s_wifi_events, WIFI_UP_BIT | WIFI_FAIL_BIT);
+    esp_netif_t **netif = s_req.mode == OTA_WIFI_MODE_STA ? &s_sta_netif : &s_ap_netif;
+    if (!*netif) {
+        *netif = s_req.mode == OTA_WIFI_MODE_STA ? esp_netif_create_default_wifi_sta() : esp_netif_create_default_wifi_ap();
+    }
+
+    ESP_RETURN_ON_ERROR(esp_wifi_init(&init), TAG, "esp_wifi_init");
+    // credentials are for this session only
+    ESP_RETURN_ON_ERROR(esp_wifi_set_storage(WIFI_STORAGE_RAM), TAG, "set_storage");
+
+    if (s_req.mode == OTA_WIFI_MODE_STA) {
+        strlcpy((char *)cfg.sta.ssid, s_req.ssid, sizeof(cfg.sta.ssid));
+        strlcpy((char *)cfg.sta.password, s_req.password, sizeof(cfg.sta.password));
+        cfg.sta.threshold.authmode = s_req.password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+        ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "set_mode");
+        ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &cfg), TAG, "set_config");
+        // BLE stays up next to Wi-Fi, and coexistence needs modem sleep; the minimum
+        // level wakes for every DTIM and costs the least throughput
+        ESP_RETURN_ON_ERROR(esp_wifi_set_ps(WIFI_PS_MIN_MODEM), TAG, "set_ps");
+    } else {
+        strlcpy((char *)cfg.ap.ssid, s_req.ssid, sizeof(cfg.ap.ssid));
+        strlcpy((char *)cfg.ap.password, s_req.password, sizeof(cfg.ap.password));
+        cfg.ap.ssid_len = strlen(s_req.ssid);
+        cfg.ap.max_connection = 1;
+        cfg.ap.authmode = s_req.password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+        ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_AP), TAG, "set_mode");
+        ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_AP, &cfg), TAG, "set_config");
+    }
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "esp_wifi_start");
+
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_events, WIFI_UP_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(CONFIG_OTA_HELPER_WIFI_TIMEOUT_MS));
+    if (!(bits & WIFI_UP_BIT)) {
+        ESP_LOGE(TAG, "%s", bits & WIFI_FAIL_BIT ? "could not join the network" : "Wi-Fi timeout");
+        return ESP_ERR_TIMEOUT;
+    }
+    if (esp_netif_get_ip_info(*netif, &ip_info) == ESP_OK) {
+        *ip4 = ip_info.ip.addr;
+    }
+    return ESP_OK;
+}
+
+// in SoftAP mode the server only gets its address some time after joining
+static esp_http_client_handle_t
+http_open(int64_t *content_len)
+{
+    esp_http_client_config_t cfg = {
+        .url = s_req.url,
+        .timeout_ms = 5000,
+        .buffer_size = OTA_WIFI_BUF_SIZE,
+        .keep_alive_enable = true,
+    };
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_OTA_HELPER_WIFI_TIMEOUT_MS);
+
+    do {
+        esp_http_client_handle_t client = esp_http_client_init(&cfg);
+        if (!client) {
+            return NULL;
+        }
+        if (esp_http_client_open(client, 0) == ESP_OK) {
+            *content_len = esp_http_client_fetch_headers(client);
+            int status = esp_http_client_get_status_code(client);
+            if (status == 200 && *content_len > 0) {
+                return client;
+            }
+            ESP_LOGE(TAG, "GET %s: status %d, length %" PRId64, s_req.url, status, *content_len);
+            esp_http_client_cleanup(client);
+            return NULL;
+        }
+        esp_http_client_cleanup(client);
+        vTaskDelay(pdMS_TO_TICKS(OTA_WIFI_HTTP_RETRY_MS));
+    } while ((int32_t)(deadline - xTaskGetTickCount()) > 0);
+
+    ESP_LOGE(TAG, "cannot reach %s", s_req.url);
+    return NULL;
+}
+
+static void
+ota_wifi_task(void *arg)
+{
+    esp_http_client_handle_t client = NULL;
+    uint8_t *buf = NULL;
+    uint32_t ip4 = 0;
+    int64_t content_len = 0;
+    int64_t recv_len = 0;
+    esp_err_t err;
+
+    err = wifi_bring_up(&ip4);
+    if (err != ESP_OK) {
+        goto FAIL;
+    }
+    ESP_LOGI(TAG, "Wi-Fi up, " IPSTR ", fetching %s", IP2STR((esp_ip4_addr_t *)&ip4), s_req.url);
+
+    buf = malloc(OTA_WIFI_BUF_SIZE);
+    client = http_open(&content_len);
+    if (!buf || !client) {
+        err = ESP_ERR_NOT_FOUND;
+        goto FAIL;
+    }
+    if (s_req.image_len && content_len != s_req.image_len) {
+        ESP_LOGE(TAG, "server has %" PRId64 " bytes, phone expects %" PRIu32, content_len, s_req.image_len);
+        err = ESP_ERR_INVALID_SIZE;
+        goto FAIL;
+    }
+    if (!ota_stream_begin((uint32_t)content_len)) {
+        err = ESP_ERR_INVALID_STATE;
+        goto FAIL;
+    }
+    s_ready_cb(ESP_OK, ip4, s_ready_arg);
+
+    // ota_task verifies, switches the boot partition and restarts; a short
+    // stream makes it time out and restart the OTA process as over BLE
+    while (recv_len < content_len) {
+        int n = esp_http_client_read(client, (char *)buf, OTA_WIFI_BUF_SIZE);
+        if (n <= 0) {
+            ESP_LOGE(TAG, "download stopped at %" PRId64 " of %" PRId64 " bytes", recv_len, content_len);
+            break;
+        }
+        if (!ota_stream_write(buf, n, pdMS_TO_TICKS(OTA_WIFI_QUEUE_WAIT_MS))) {
+            ESP_LOGE(TAG, "OTA writer stalled");
+            break;
+        }
+        recv_len += n;
+    }
+    ESP_LOGI(TAG, "download done, %" PRId64 " bytes", recv_len);
+    esp_http_client_cleanup(client);
+    free(buf);
+    vTaskDelete(NULL);
+    return;
+
+FAIL:
+    ESP_LOGE(TAG, "Wi-Fi OTA failed: %s", esp_err_to_name(err));
+    if (client) {
+        esp_http_client_cleanup(client);
+    }
+    free(buf);
+    esp_wifi_stop();
+    esp_wifi_deinit();
+    s_running = false;
+    s_ready_cb(err, 0, s_ready_arg);
+    vTaskDelete(NULL);
+}
+
+uint8_t
+ota_wifi_modes(void)
+{
+    return OTA_WIFI_MODE_STA | OTA_WIFI_MODE_SOFTAP;
+}
+
+bool
+ota_wifi_start(const ota_wifi_req_t *req, ota_wifi_ready_cb_t cb, void *arg)
+{
+    if (s_running || !(req->mode & ota_wifi_modes()) || !req->url[0]) {
+        return false;
+    }
+    s_req = *req;
+    s_ready_cb = cb;
+    s_ready_arg = arg;
+    s_sta_retries = 0;
+    s_running = true;
+    if (xTaskCreate(ota_wifi_task, "ota_wifi", OTA_WIFI_TASK_SIZE, NULL, 5, NULL) != pdPASS) {
+        s_running = false;
+        return false;
+    }
+    return true;
+}
+
+#endif /* CONFIG_OTA_HELPER_WIFI */
@@ -8,6 +8,7 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "ota_helper.h"
+#include "ota_boot.h"
 #include "hello_world.h"
 #include "blink.h"
 
@@ -18,6 +19,7 @@ static const char *TAG = "APP_MAIN";
 
 void app_main(void)
 {
+    ota_boot_mark(OTA_BOOT_APP_MAIN);
     ESP_LOGI(TAG, "Initializing nvs flash");
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -26,10 +28,11 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    ota_boot_mark(OTA_BOOT_NVS);
 
     ESP_LOGI(TAG, "Initializing BLE OTA & Hello World & Blink task");
 
-    // Initialize BLE OTA
+    // BLE OTA: up now or after the application started, see OTA_HELPER_BRINGUP
     if (!ble_ota_helper_init()) {
         ESP_LOGE(TAG, "Failed to initialize BLE OTA");
         return;
@@ -59,6 +62,7 @@ void app_main(void)
         2,
         NULL
     );
+    ota_boot_mark(OTA_BOOT_APP_TASKS);
 
     ESP_LOGI(TAG, "System initialization complete");
 
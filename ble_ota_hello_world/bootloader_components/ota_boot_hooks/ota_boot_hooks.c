@@ -0,0 +1,61 @@
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "bootloader_common.h"
+#include "ota_boot.h"
+
+// Stamps the bootloader phases of the boot profile into the custom part of
+// the RTC retain memory, where ota_boot.c picks them up. Times are CPU
+// cycles since reset at the current CPU clock, as the bootloader's own log
+// timestamps. With OTA_HELPER_BOOT_PROFILE off nothing is reserved and the
+// hooks do nothing.
+#if CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC
+_Static_assert(sizeof(ota_boot_rtc_t) <= CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC_SIZE,
+               "BOOTLOADER_CUSTOM_RESERVE_RTC_SIZE too small for the boot profile");
+
+static uint32_t
+now_us(void)
+{
+    return esp_cpu_get_cycle_count() / esp_rom_get_cpu_ticks_per_us();
+}
+
+static ota_boot_rtc_t *
+rtc_record(void)
+{
+    return (ota_boot_rtc_t *)bootloader_common_get_rtc_retain_mem()->custom;
+}
+#endif
+
+void
+ota_boot_hooks_include(void)
+{
+}
+
+// before the bootloader sets up clocks, flash and console: ROM time only
+void
+bootloader_before_init(void)
+{
+#if CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC
+    ota_boot_rtc_t *rec = rtc_record();
+    rec->magic = 0;
+    rec->bootloader_us = now_us();
+    rec->image_load_us = 0;
+#endif
+}
+
+// partition selection, image validation and load come next
+void
+bootloader_after_init(void)
+{
+#if CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC
+    ota_boot_rtc_t *rec = rtc_record();
+    rec->image_load_us = now_us();
+    rec->magic = OTA_BOOT_RTC_MAGIC;
+#if CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC_IN_CRC
+    // the custom bytes are covered by the retain memory CRC, keep it valid
+    bootloader_common_update_rtc_retain_mem(NULL, false);
+#endif
+#endif
+}
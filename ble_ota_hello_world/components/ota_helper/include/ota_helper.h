@@ -1,7 +1,20 @@
 #pragma once
 
-// Function to initialize the BLE OTA
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+// Bring up BLE OTA as configured by OTA_HELPER_BRINGUP: right here, from a
+// low-priority task once the application runs, or only on a trigger.
+// NVS must be initialized first.
 bool ble_ota_helper_init();
 
+// Bring BLE OTA up now from a low-priority task, e.g. from a menu or a timer
+// in trigger mode. Does nothing once it is up or on its way.
+bool ble_ota_helper_start(void);
+
+// Trigger mode: bring BLE OTA up on the next boot (one-shot NVS flag).
+esp_err_t ble_ota_helper_request_at_boot(void);
+
 // ota task function
 void ota_task(void *arg);
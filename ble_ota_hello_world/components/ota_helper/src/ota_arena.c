@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "ota_arena.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#endif
+
+static const char *TAG = "OTA_ARENA";
+
+#define OTA_ARENA_ALIGN                     8
+
+static struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    bool spiram;
+} s_arena;
+
+size_t
+ota_arena_footprint(size_t len)
+{
+    return (len + OTA_ARENA_ALIGN - 1) & ~(size_t)(OTA_ARENA_ALIGN - 1);
+}
+
+bool
+ota_arena_create(size_t size)
+{
+    if (s_arena.base) {
+        return false;
+    }
+#if CONFIG_IDF_TARGET_LINUX
+    s_arena.base = malloc(size);
+#else
+#if CONFIG_OTA_HELPER_ARENA_SPIRAM
+    s_arena.base = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    s_arena.spiram = s_arena.base != NULL;
+    if (!s_arena.base && size > OTA_ARENA_INTERNAL_MAX) {
+        ESP_LOGW(TAG, "no room for a %zu B OTA arena in PSRAM", size);
+        return false;
+    }
+#endif
+    if (!s_arena.base) {
+        s_arena.base = heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+#endif
+    if (!s_arena.base) {
+        ESP_LOGE(TAG, "no room for a %zu B OTA arena", size);
+        return false;
+    }
+    s_arena.size = size;
+    s_arena.used = 0;
+    return true;
+}
+
+void *
+ota_arena_alloc(size_t len)
+{
+    size_t need = ota_arena_footprint(len);
+
+    if (!s_arena.base || s_arena.size - s_arena.used < need) {
+        ESP_LOGE(TAG, "arena exhausted: %zu B asked, %zu of %zu B left", len, s_arena.size - s_arena.used,
+                 s_arena.size);
+        return NULL;
+    }
+    void *p = s_arena.base + s_arena.used;
+    s_arena.used += need;
+    return p;
+}
+
+void
+ota_arena_destroy(void)
+{
+    if (!s_arena.base) {
+        return;
+    }
+    // a bump allocator never gives back, so what is used now is the peak
+    ESP_LOGI(TAG, "session used %zu of %zu B (%s), released", s_arena.used, s_arena.size,
+             s_arena.spiram ? "PSRAM" : "internal RAM");
+    free(s_arena.base);
+    s_arena.base = NULL;
+    s_arena.size = 0;
+    s_arena.used = 0;
+    s_arena.spiram = false;
+}
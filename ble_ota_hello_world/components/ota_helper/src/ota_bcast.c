@@ -0,0 +1,629 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_image_format.h"
+#include "esp_system.h"
+#include "host/ble_hs.h"
+#include "host/ble_gap.h"
+
+#include "ota_bcast.h"
+#include "ota_ctrl.h"
+#include "ota_boot.h"
+#include "ota_relay.h"
+
+#if CONFIG_OTA_HELPER_BCAST_SOURCE || CONFIG_OTA_HELPER_BCAST_RECEIVER
+
+static const char *TAG = "OTA_BCAST";
+
+#define BCAST_SECTOR_SIZE                   4096
+#define BCAST_FRAG_SIZE                     200
+#define BCAST_FRAGS_PER_SECTOR              ((BCAST_SECTOR_SIZE + BCAST_FRAG_SIZE - 1) / BCAST_FRAG_SIZE)
+#define BCAST_GROUP                         CONFIG_OTA_HELPER_BCAST_FEC_GROUP
+#define BCAST_SID                           0x0B
+#define BCAST_INSTANCE                      1
+#define BCAST_TASK_SIZE                     4096
+#define BCAST_COMPANY_ID                    0x02E5   // Espressif
+#define BCAST_MAGIC0                        'O'
+#define BCAST_MAGIC1                        'T'
+#define BCAST_FLAG_PARITY                   0x01
+#define BCAST_SYNC_TIMEOUT_MS               5000
+#define BCAST_STOP_TIMEOUT_MS               5000
+// both group buffers plus a switch to a new image
+#define BCAST_WRITE_QUEUE_LEN               3
+#define BCAST_CMD_STOP                      -1
+#define BCAST_CMD_RESET                     -2
+
+// Periodic advertising payload, one manufacturer-specific AD structure:
+// [len][0xFF][company u16][magic 'O''T'][image_id u32][image_len u32][sector u16][frag u8][flags u8][data]
+// image_id is the first 4 bytes of the source's ELF SHA-256. A parity
+// fragment carries the XOR of fragment `frag` of every sector in the group
+// starting at `sector`, zero padded, and repairs one missing sector per group.
+#define BCAST_HDR_LEN                       18
+#define BCAST_AD_MAX                        (BCAST_HDR_LEN + BCAST_FRAG_SIZE)
+
+static inline void put_u16(uint8_t *p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static inline void put_u32(uint8_t *p, uint32_t v) { put_u16(p, v & 0xFFFF); put_u16(p + 2, v >> 16); }
+static inline uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+static uint32_t
+own_image_id(void)
+{
+    return get_u32(esp_app_get_description()->app_elf_sha256);
+}
+
+// the identity address is only known once the host has synced
+static bool
+wait_host_sync(void)
+{
+    for (int waited = 0; !ble_hs_synced(); waited += 10) {
+        if (waited >= BCAST_SYNC_TIMEOUT_MS) {
+            ESP_LOGE(TAG, "host did not sync");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+static inline size_t
+sector_len(uint32_t image_len, uint32_t sector)
+{
+    return MIN(BCAST_SECTOR_SIZE, image_len - sector * BCAST_SECTOR_SIZE);
+}
+
+/* ------------------------------ source ------------------------------------------- */
+#if CONFIG_OTA_HELPER_BCAST_SOURCE
+
+static int
+send_frag(uint32_t image_id, uint32_t image_len, uint16_t sector, uint8_t frag, uint8_t flags,
+          const uint8_t *data, size_t len)
+{
+    uint8_t ad[BCAST_AD_MAX];
+
+    ad[0] = BCAST_HDR_LEN - 1 + len;
+    ad[1] = BLE_HS_ADV_TYPE_MFG_DATA;
+    put_u16(ad + 2, BCAST_COMPANY_ID);
+    ad[4] = BCAST_MAGIC0;
+    ad[5] = BCAST_MAGIC1;
+    put_u32(ad + 6, image_id);
+    put_u32(ad + 10, image_len);
+    put_u16(ad + 14, sector);
+    ad[16] = frag;
+    ad[17] = flags;
+    memcpy(ad + BCAST_HDR_LEN, data, len);
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(ad, BCAST_HDR_LEN + len);
+    if (!om) {
+        return BLE_HS_ENOMEM;
+    }
+#if MYNEWT_VAL(BLE_PERIODIC_ADV_ENH)
+    int rc = ble_gap_periodic_adv_set_data(BCAST_INSTANCE, om, NULL);
+#else
+    int rc = ble_gap_periodic_adv_set_data(BCAST_INSTANCE, om);
+#endif
+    // every fragment stays up for at least one periodic event
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_OTA_HELPER_BCAST_ITVL_MS) + 1);
+    return rc;
+}
+
+static void
+bcast_source_task(void *arg)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    const esp_partition_pos_t pos = { .offset = running->address, .size = running->size };
+    esp_image_metadata_t meta;
+    uint8_t *group = malloc(BCAST_GROUP * BCAST_SECTOR_SIZE);
+    uint8_t parity[BCAST_FRAG_SIZE];
+
+    if (!group || esp_image_get_metadata(&pos, &meta) != ESP_OK) {
+        ESP_LOGE(TAG, "cannot load the running image");
+        free(group);
+        vTaskDelete(NULL);
+        return;
+    }
+    uint32_t image_len = meta.image_len;
+    uint32_t image_id = own_image_id();
+    uint32_t num_sectors = (image_len + BCAST_SECTOR_SIZE - 1) / BCAST_SECTOR_SIZE;
+    ESP_LOGI(TAG, "broadcasting %" PRIu32 " bytes, image id %08" PRIx32 ", FEC group %d",
+             image_len, image_id, BCAST_GROUP);
+
+    // carousel: receivers that missed a group pick it up on a later pass
+    for (uint32_t pass = 0;; pass++) {
+        uint32_t unsent = 0;
+        for (uint32_t first = 0; first < num_sectors; first += BCAST_GROUP) {
+            uint32_t n = MIN(BCAST_GROUP, num_sectors - first);
+            esp_err_t err = ESP_OK;
+            memset(group, 0, BCAST_GROUP * BCAST_SECTOR_SIZE);
+            for (uint32_t i = 0; i < n && err == ESP_OK; i++) {
+                err = esp_partition_read(running, (first + i) * BCAST_SECTOR_SIZE,
+                                         group + i * BCAST_SECTOR_SIZE, sector_len(image_len, first + i));
+            }
+            // parity over a half-read group would repair receivers with garbage
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "reading sectors %" PRIu32 "+ failed: %s", first, esp_err_to_name(err));
+                continue;
+            }
+            for (uint8_t f = 0; f < BCAST_FRAGS_PER_SECTOR; f++) {
+                uint32_t off = f * BCAST_FRAG_SIZE;
+                memset(parity, 0, sizeof(parity));
+                for (uint32_t i = 0; i < n; i++) {
+                    size_t len = sector_len(image_len, first + i);
+                    if (off >= len) {
+                        continue;
+                    }
+                    const uint8_t *src = group + i * BCAST_SECTOR_SIZE + off;
+                    size_t frag_len = MIN(BCAST_FRAG_SIZE, len - off);
+                    unsent += send_frag(image_id, image_len, first + i, f, 0, src, frag_len) != 0;
+                    for (size_t b = 0; b < frag_len; b++) {
+                        parity[b] ^= src[b];
+                    }
+                }
+                unsent += send_frag(image_id, image_len, first, f, BCAST_FLAG_PARITY, parity, sizeof(parity)) != 0;
+            }
+        }
+        // a fragment that did not go out is only late, the next pass has it
+        if (unsent) {
+            ESP_LOGW(TAG, "carousel pass %" PRIu32 ": %" PRIu32 " fragments not sent", pass, unsent);
+        } else {
+            ESP_LOGI(TAG, "carousel pass %" PRIu32 " done", pass);
+        }
+    }
+}
+
+bool
+ota_bcast_source_start(void)
+{
+    struct ble_gap_ext_adv_params params = { 0 };
+    struct ble_gap_periodic_adv_params pparams = { 0 };
+    uint8_t own_addr_type;
+    int rc;
+
+    if (!wait_host_sync() || ble_hs_id_infer_auto(0, &own_addr_type) != 0) {
+        return false;
+    }
+    params.own_addr_type = own_addr_type;
+    params.primary_phy = BLE_HCI_LE_PHY_1M;
+    params.secondary_phy = BLE_HCI_LE_PHY_2M;
+    params.sid = BCAST_SID;
+    params.tx_power = 127;
+    params.itvl_min = BLE_GAP_ADV_ITVL_MS(200);
+    params.itvl_max = BLE_GAP_ADV_ITVL_MS(200);
+    pparams.itvl_min = BLE_GAP_PERIODIC_ITVL_MS(CONFIG_OTA_HELPER_BCAST_ITVL_MS);
+    pparams.itvl_max = BLE_GAP_PERIODIC_ITVL_MS(CONFIG_OTA_HELPER_BCAST_ITVL_MS);
+
+    rc = ble_gap_ext_adv_configure(BCAST_INSTANCE, &params, NULL, NULL, NULL);
+    if (rc == 0) rc = ble_gap_periodic_adv_configure(BCAST_INSTANCE, &pparams);
+    if (rc == 0) rc = ble_gap_periodic_adv_start(BCAST_INSTANCE);
+    if (rc == 0) rc = ble_gap_ext_adv_start(BCAST_INSTANCE, 0, 0);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "periodic advertising setup failed: %d", rc);
+        return false;
+    }
+    return xTaskCreate(bcast_source_task, "ota_bcast_tx", BCAST_TASK_SIZE, NULL, 3, NULL) == pdPASS;
+}
+
+#endif /* CONFIG_OTA_HELPER_BCAST_SOURCE */
+
+/* ------------------------------ receiver ----------------------------------------- */
+#if CONFIG_OTA_HELPER_BCAST_RECEIVER
+
+typedef struct {
+    int32_t first;                 // first sector of the group, -1 when free
+    uint32_t image_id;             // image the group belongs to
+    uint32_t image_len;
+    uint32_t count;                // sectors in the group
+    uint32_t have[BCAST_GROUP];    // received fragments per sector
+    uint32_t parity_have;
+    volatile bool busy;            // handed to the writer task
+    uint8_t parity[BCAST_FRAGS_PER_SECTOR * BCAST_FRAG_SIZE];
+    uint8_t data[BCAST_GROUP][BCAST_SECTOR_SIZE];
+} bcast_group_t;
+
+// Owned by the writer task, including every reset; the host task only reads
+// the image it belongs to (under s_rx_lock) and the written bits.
+static struct {
+    uint32_t image_id;
+    uint32_t image_len;
+    uint32_t num_sectors;
+    uint32_t written_count;
+    uint8_t written[OTA_CTRL_MAX_SECTORS / 8];
+    const esp_partition_t *target;
+} s_rx;
+static portMUX_TYPE s_rx_lock = portMUX_INITIALIZER_UNLOCKED;
+// image the host task saw on air and asked the writer to switch to
+static struct {
+    uint32_t image_id;
+    uint32_t image_len;
+} s_next;
+
+static bcast_group_t *s_groups[2];
+static int s_cur;
+static QueueHandle_t s_write_queue;
+static SemaphoreHandle_t s_writer_done;  // given by the writer task on its way out
+static volatile uint32_t s_rejected_id;  // image that is not a newer build of this project
+static uint8_t s_own_addr_type;
+static volatile bool s_stop;
+static bool s_syncing;
+static bool s_synced;
+static uint16_t s_sync_handle;
+
+static int bcast_gap_event(struct ble_gap_event *event, void *arg);
+
+static inline bool
+sector_written(uint32_t sector)
+{
+    return s_rx.written[sector / 8] & (1 << (sector % 8));
+}
+
+static bool
+group_written(uint32_t first, uint32_t num_sectors)
+{
+    for (uint32_t s = first; s < MIN(first + BCAST_GROUP, num_sectors); s++) {
+        if (!sector_written(s)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fill what is missing from parity where possible; true once every sector
+// of the group is complete.
+static bool
+group_complete(bcast_group_t *g)
+{
+    for (uint32_t f = 0; f < BCAST_FRAGS_PER_SECTOR; f++) {
+        uint32_t off = f * BCAST_FRAG_SIZE;
+        int missing = -1, num_missing = 0;
+        for (uint32_t i = 0; i < g->count; i++) {
+            if (off < sector_len(g->image_len, g->first + i) && !(g->have[i] & (1u << f))) {
+                missing = i;
+                num_missing++;
+            }
+        }
+        if (num_missing == 0) {
+            continue;
+        }
+        if (num_missing > 1 || !(g->parity_have & (1u << f))) {
+            return false;
+        }
+        size_t len = MIN(BCAST_FRAG_SIZE, sector_len(g->image_len, g->first + missing) - off);
+        uint8_t *dst = g->data[missing] + off;
+        memcpy(dst, g->parity + off, len);
+        for (uint32_t i = 0; i < g->count; i++) {
+            if (i == missing) {
+                continue;
+            }
+            // data[] is zeroed on group start, so short sectors xor in as zero padding
+            for (size_t b = 0; b < len; b++) {
+                dst[b] ^= g->data[i][off + b];
+            }
+        }
+        g->have[missing] |= 1u << f;
+    }
+    return true;
+}
+
+static bcast_group_t *
+group_for(uint32_t first, uint32_t image_id, uint32_t image_len, uint32_t num_sectors)
+{
+    bcast_group_t *g = s_groups[s_cur];
+    if (g->first == (int32_t)first && g->image_id == image_id && !g->busy) {
+        return g;
+    }
+    // an unfinished group is abandoned, a later carousel pass brings it again
+    if (g->busy) {
+        s_cur ^= 1;
+        g = s_groups[s_cur];
+        if (g->busy) {
+            return NULL;
+        }
+    }
+    memset(g, 0, sizeof(*g));
+    g->first = first;
+    g->image_id = image_id;
+    g->image_len = image_len;
+    g->count = MIN(BCAST_GROUP, num_sectors - first);
+    return g;
+}
+
+// writer task only
+static void
+rx_reset(uint32_t image_id, uint32_t image_len)
+{
+    const esp_partition_t *target = esp_ota_get_next_update_partition(NULL);
+
+    taskENTER_CRITICAL(&s_rx_lock);
+    memset(s_rx.written, 0, sizeof(s_rx.written));
+    s_rx.written_count = 0;
+    s_rx.image_id = image_id;
+    s_rx.image_len = image_len;
+    s_rx.num_sectors = (image_len + BCAST_SECTOR_SIZE - 1) / BCAST_SECTOR_SIZE;
+    s_rx.target = target;
+    taskEXIT_CRITICAL(&s_rx_lock);
+    ESP_LOGI(TAG, "receiving image %08" PRIx32 ", %" PRIu32 " bytes", image_id, image_len);
+}
+
+// host task context: only copies into the group buffer, flash work goes to the writer task
+static void
+handle_frag(const uint8_t *ad, size_t len)
+{
+    if (len < BCAST_HDR_LEN || ad[1] != BLE_HS_ADV_TYPE_MFG_DATA || get_u16(ad + 2) != BCAST_COMPANY_ID ||
+        ad[4] != BCAST_MAGIC0 || ad[5] != BCAST_MAGIC1 || s_stop) {
+        return;
+    }
+    uint32_t image_id = get_u32(ad + 6);
+    uint32_t image_len = get_u32(ad + 10);
+    uint16_t sector = get_u16(ad + 14);
+    uint8_t frag = ad[16];
+    uint8_t flags = ad[17];
+    const uint8_t *data = ad + BCAST_HDR_LEN;
+    size_t data_len = len - BCAST_HDR_LEN;
+
+    if (image_id == own_image_id() || image_id == s_rejected_id || image_len == 0 ||
+        image_len > (uint32_t)OTA_CTRL_MAX_SECTORS * BCAST_SECTOR_SIZE || frag >= BCAST_FRAGS_PER_SECTOR) {
+        return;
+    }
+    // the writer may be mid-sector of the old image: it switches over
+    // itself, and fragments of the new one are dropped until it has
+    taskENTER_CRITICAL(&s_rx_lock);
+    bool current = image_id == s_rx.image_id && image_len == s_rx.image_len;
+    bool ask = !current && (image_id != s_next.image_id || image_len != s_next.image_len);
+    if (ask) {
+        s_next.image_id = image_id;
+        s_next.image_len = image_len;
+    }
+    uint32_t num_sectors = s_rx.num_sectors;
+    taskEXIT_CRITICAL(&s_rx_lock);
+    if (!current) {
+        int cmd = BCAST_CMD_RESET;
+        if (ask && xQueueSend(s_write_queue, &cmd, 0) != pdTRUE) {
+            s_next.image_id = 0;  // asked again with the next fragment
+        }
+        return;
+    }
+    if (sector >= num_sectors) {
+        return;
+    }
+    uint32_t first = sector - sector % BCAST_GROUP;
+    if (group_written(first, num_sectors)) {
+        return;
+    }
+    bcast_group_t *g = group_for(first, image_id, image_len, num_sectors);
+    if (!g) {
+        return;
+    }
+
+    uint32_t off = frag * BCAST_FRAG_SIZE;
+    if (flags & BCAST_FLAG_PARITY) {
+        memcpy(g->parity + off, data, MIN(data_len, BCAST_FRAG_SIZE));
+        g->parity_have |= 1u << frag;
+    } else {
+        uint32_t i = sector - first;
+        size_t max = sector_len(image_len, sector);
+        if (off >= max) {
+            return;
+        }
+        memcpy(g->data[i] + off, data, MIN(data_len, max - off));
+        g->have[i] |= 1u << frag;
+    }
+
+    if (group_complete(g)) {
+        int idx = s_cur;
+        g->busy = true;
+        s_cur ^= 1;
+        xQueueSend(s_write_queue, &idx, 0);
+    }
+}
+
+// Same rule as the relay: only a strictly newer build of this project is
+// taken. The image id only says the build differs, so the app descriptor is
+// checked as soon as sector 0 is in, and again on flash before committing.
+static bool
+image_acceptable(const esp_app_desc_t *app, uint32_t image_id)
+{
+    const esp_app_desc_t *own = esp_app_get_description();
+
+    if (ota_relay_app_newer(app, own)) {
+        return true;
+    }
+    ESP_LOGW(TAG, "ignoring broadcast of %.32s %.32s, we run %.32s %.32s",
+             app->project_name, app->version, own->project_name, own->version);
+    s_rejected_id = image_id;
+    return false;
+}
+
+static void
+bcast_writer_task(void *arg)
+{
+    int idx;
+
+    for (;;) {
+        xQueueReceive(s_write_queue, &idx, portMAX_DELAY);
+        if (s_stop) {
+            break;
+        }
+        if (idx == BCAST_CMD_RESET) {
+            taskENTER_CRITICAL(&s_rx_lock);
+            uint32_t image_id = s_next.image_id;
+            uint32_t image_len = s_next.image_len;
+            taskEXIT_CRITICAL(&s_rx_lock);
+            rx_reset(image_id, image_len);
+            continue;
+        }
+        bcast_group_t *g = s_groups[idx];
+        // completed just before the writer switched to another image
+        bool stale = g->image_id != s_rx.image_id || g->image_len != s_rx.image_len;
+        if (stale ||
+            (g->first == 0 &&
+             !image_acceptable((const esp_app_desc_t *)(g->data[0] + sizeof(esp_image_header_t) +
+                                                        sizeof(esp_image_segment_header_t)),
+                               g->image_id))) {
+            g->first = -1;
+            g->busy = false;
+            continue;
+        }
+        for (uint32_t i = 0; i < g->count; i++) {
+            uint32_t sector = g->first + i;
+            uint32_t off = sector * BCAST_SECTOR_SIZE;
+            if (s_stop) {
+                break;
+            }
+            if (sector_written(sector)) {
+                continue;
+            }
+            if (esp_partition_erase_range(s_rx.target, off, BCAST_SECTOR_SIZE) != ESP_OK ||
+                esp_partition_write(s_rx.target, off, g->data[i], sector_len(s_rx.image_len, sector)) != ESP_OK) {
+                ESP_LOGE(TAG, "writing sector %" PRIu32 " failed", sector);
+                continue;
+            }
+            s_rx.written[sector / 8] |= 1 << (sector % 8);
+            s_rx.written_count++;
+        }
+        g->first = -1;
+        g->busy = false;
+        ESP_LOGI(TAG, "%" PRIu32 "/%" PRIu32 " sectors", s_rx.written_count, s_rx.num_sectors);
+
+        if (s_rx.written_count < s_rx.num_sectors) {
+            continue;
+        }
+        const esp_partition_pos_t pos = { .offset = s_rx.target->address, .size = s_rx.target->size };
+        esp_image_metadata_t meta;
+        esp_app_desc_t app;
+        if (esp_ota_get_partition_description(s_rx.target, &app) != ESP_OK ||
+            !image_acceptable(&app, s_rx.image_id)) {
+            continue;
+        }
+        if (esp_image_verify(ESP_IMAGE_VERIFY, &pos, &meta) == ESP_OK && meta.image_len == s_rx.image_len &&
+            esp_ota_set_boot_partition(s_rx.target) == ESP_OK) {
+            ESP_LOGI(TAG, "broadcast image verified, rebooting...");
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            ota_boot_note_update();
+            esp_restart();
+        }
+        ESP_LOGE(TAG, "broadcast image failed verification, starting over");
+        rx_reset(s_rx.image_id, s_rx.image_len);
+    }
+    ESP_LOGI(TAG, "receiver stopped at %" PRIu32 "/%" PRIu32 " sectors", s_rx.written_count, s_rx.num_sectors);
+    xSemaphoreGive(s_writer_done);
+    vTaskDelete(NULL);
+}
+
+static void
+start_discovery(void)
+{
+    struct ble_gap_ext_disc_params uncoded = { .itvl = BLE_GAP_SCAN_ITVL_MS(100), .window = BLE_GAP_SCAN_WIN_MS(50) };
+    int rc = ble_gap_ext_disc(s_own_addr_type, 0, 0, 1, BLE_HCI_SCAN_FILT_NO_WL, 0, &uncoded, NULL,
+                              bcast_gap_event, NULL);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        ESP_LOGE(TAG, "ext discovery failed: %d", rc);
+    }
+}
+
+static int
+bcast_gap_event(struct ble_gap_event *event, void *arg)
+{
+    switch (event->type) {
+    case BLE_GAP_EVENT_EXT_DISC:
+        if (!s_syncing && !s_stop && event->ext_disc.sid == BCAST_SID && event->ext_disc.periodic_adv_itvl) {
+            struct ble_gap_periodic_sync_params params = { .skip = 0, .sync_timeout = 1000 };
+            if (ble_gap_periodic_adv_sync_create(&event->ext_disc.addr, event->ext_disc.sid, &params,
+                                                 bcast_gap_event, NULL) == 0) {
+                s_syncing = true;
+            }
+        }
+        break;
+    case BLE_GAP_EVENT_PERIODIC_SYNC:
+        if (event->periodic_sync.status == 0) {
+            ESP_LOGI(TAG, "synced to broadcast source");
+            s_synced = true;
+            s_sync_handle = event->periodic_sync.sync_handle;
+            ble_gap_disc_cancel();
+        } else {
+            s_syncing = false;
+        }
+        break;
+    case BLE_GAP_EVENT_PERIODIC_REPORT:
+        if (event->periodic_report.data_status == BLE_HCI_PERIODIC_DATA_STATUS_COMPLETE) {
+            handle_frag(event->periodic_report.data, event->periodic_report.data_length);
+        }
+        break;
+    case BLE_GAP_EVENT_PERIODIC_SYNC_LOST:
+        ESP_LOGW(TAG, "broadcast sync lost");
+        s_syncing = false;
+        s_synced = false;
+        if (!s_stop) {
+            start_discovery();
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+bool
+ota_bcast_receiver_start(void)
+{
+    if (!wait_host_sync() || ble_hs_id_infer_auto(0, &s_own_addr_type) != 0) {
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        s_groups[i] = calloc(1, sizeof(bcast_group_t));
+        if (!s_groups[i]) {
+            ESP_LOGE(TAG, "no memory for FEC group buffers");
+            return false;
+        }
+        s_groups[i]->first = -1;
+    }
+    s_write_queue = xQueueCreate(BCAST_WRITE_QUEUE_LEN, sizeof(int));
+    s_writer_done = xSemaphoreCreateBinary();
+    if (!s_write_queue || !s_writer_done ||
+        xTaskCreate(bcast_writer_task, "ota_bcast_rx", BCAST_TASK_SIZE, NULL, 5, NULL) != pdPASS) {
+        return false;
+    }
+    start_discovery();
+    return true;
+}
+
+// Blocks until the writer task is out of the target partition, so the caller
+// can hand that partition to ota_task.
+void
+ota_bcast_receiver_stop(void)
+{
+    int idx = BCAST_CMD_STOP;
+
+    if (!s_writer_done || s_stop) {
+        return;
+    }
+    s_stop = true;
+    ble_gap_disc_cancel();
+    if (s_synced) {
+        ble_gap_periodic_adv_sync_terminate(s_sync_handle);
+        s_synced = false;
+    } else if (s_syncing) {
+        ble_gap_periodic_adv_sync_create_cancel();
+    }
+    s_syncing = false;
+
+    // wakes the writer if it is idle; a busy one sees s_stop after the current sector
+    xQueueSend(s_write_queue, &idx, pdMS_TO_TICKS(BCAST_STOP_TIMEOUT_MS));
+    if (xSemaphoreTake(s_writer_done, pdMS_TO_TICKS(BCAST_STOP_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGE(TAG, "writer task did not stop");
+    }
+}
+
+#endif /* CONFIG_OTA_HELPER_BCAST_RECEIVER */
+
+#endif /* CONFIG_OTA_HELPER_BCAST_SOURCE || CONFIG_OTA_HELPER_BCAST_RECEIVER */
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Broadcast OTA over BLE periodic advertising. The source streams its running
+// image as numbered sector fragments plus XOR parity, in a carousel; receivers
+// collect whole FEC groups into the inactive partition in any order and boot
+// the image once every sector is in and the image verifies.
+
+// Start broadcasting the running image (CONFIG_OTA_HELPER_BCAST_SOURCE).
+bool ota_bcast_source_start(void);
+
+// Start listening for a broadcast of a newer build of this project
+// (CONFIG_OTA_HELPER_BCAST_RECEIVER).
+bool ota_bcast_receiver_start(void);
+
+// Stop receiving, e.g. because a phone started a ble_ota transfer. Ends the
+// periodic sync and returns once the writer task has left the inactive partition.
+void ota_bcast_receiver_stop(void);
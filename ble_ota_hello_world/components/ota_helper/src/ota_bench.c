@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "ota_bench.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#endif
+
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+
+static const char *TAG = "OTA_BENCH";
+
+// histogram bucket upper edges (ms); the last bucket is open ended
+static const uint16_t s_edges_ms[] = { 1, 2, 5, 10, 20, 50, 100, 200 };
+#define BENCH_BUCKETS                       (sizeof(s_edges_ms) / sizeof(s_edges_ms[0]) + 1)
+
+#if CONFIG_OTA_HELPER_SINK_DISCARD
+#define BENCH_SINK_NAME                     "discard"
+#elif CONFIG_OTA_HELPER_SINK_SCRATCH
+#define BENCH_SINK_NAME                     "scratch"
+#else
+#define BENCH_SINK_NAME                     "full"
+#endif
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && CONFIG_FREERTOS_USE_TRACE_FACILITY && !CONFIG_IDF_TARGET_LINUX
+#define BENCH_CPU_LOAD                      1
+#define BENCH_MAX_TASKS                     32
+#endif
+
+static struct {
+    int64_t start_us;
+    uint64_t recv_bytes;
+    uint64_t copied_bytes;
+    uint32_t sectors;
+    uint32_t recv_sectors;
+    int64_t wait_us;
+    int64_t write_us;
+    int64_t max_wait_us;
+    int64_t max_write_us;
+    uint32_t wait_hist[BENCH_BUCKETS];
+    uint32_t write_hist[BENCH_BUCKETS];
+#if BENCH_CPU_LOAD
+    configRUN_TIME_COUNTER_TYPE idle[configNUMBER_OF_CORES];
+    configRUN_TIME_COUNTER_TYPE total;
+#endif
+} s_bench;
+
+int64_t
+ota_bench_now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static void
+hist_add(uint32_t *hist, int64_t us)
+{
+    size_t i = 0;
+    while (i < BENCH_BUCKETS - 1 && us >= (int64_t)s_edges_ms[i] * 1000) {
+        i++;
+    }
+    hist[i]++;
+}
+
+static void
+hist_log(const char *name, const uint32_t *hist)
+{
+    char line[160];
+    int n = snprintf(line, sizeof(line), "%-6s", name);
+    for (size_t i = 0; i < BENCH_BUCKETS && n < (int)sizeof(line); i++) {
+        n += snprintf(line + n, sizeof(line) - n, " %6" PRIu32, hist[i]);
+    }
+    ESP_LOGI(TAG, "%s", line);
+}
+
+#if BENCH_CPU_LOAD
+// idle time per core and the run time counter, from the scheduler's statistics
+static void
+cpu_snapshot(configRUN_TIME_COUNTER_TYPE *idle, configRUN_TIME_COUNTER_TYPE *total)
+{
+    static TaskStatus_t tasks[BENCH_MAX_TASKS];
+    UBaseType_t n = uxTaskGetSystemState(tasks, BENCH_MAX_TASKS, total);
+
+    memset(idle, 0, sizeof(configRUN_TIME_COUNTER_TYPE) * configNUMBER_OF_CORES);
+    for (UBaseType_t i = 0; i < n; i++) {
+        for (BaseType_t core = 0; core < configNUMBER_OF_CORES; core++) {
+            if (tasks[i].xHandle == xTaskGetIdleTaskHandleForCore(core)) {
+                idle[core] = tasks[i].ulRunTimeCounter;
+            }
+        }
+    }
+}
+#endif
+
+void
+ota_bench_begin(void)
+{
+    memset(&s_bench, 0, sizeof(s_bench));
+    s_bench.start_us = ota_bench_now_us();
+#if BENCH_CPU_LOAD
+    cpu_snapshot(s_bench.idle, &s_bench.total);
+#endif
+}
+
+void
+ota_bench_sector(size_t bytes, int64_t wait_us, int64_t write_us, bool copied)
+{
+    s_bench.sectors++;
+    s_bench.write_us += write_us;
+    s_bench.max_write_us = MAX(s_bench.max_write_us, write_us);
+    hist_add(s_bench.write_hist, write_us);
+    if (copied) {
+        s_bench.copied_bytes += bytes;
+        return;
+    }
+    s_bench.recv_bytes += bytes;
+    s_bench.recv_sectors++;
+    s_bench.wait_us += wait_us;
+    s_bench.max_wait_us = MAX(s_bench.max_wait_us, wait_us);
+    hist_add(s_bench.wait_hist, wait_us);
+}
+
+void
+ota_bench_end(esp_err_t err)
+{
+    int64_t elapsed_us = ota_bench_now_us() - s_bench.start_us;
+
+    if (elapsed_us <= 0 || s_bench.sectors == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "sink %s, %s: %" PRIu32 " sectors, %" PRIu64 " B received + %" PRIu64 " B copied in %.3f s",
+             BENCH_SINK_NAME, err == ESP_OK ? "ok" : esp_err_to_name(err), s_bench.sectors, s_bench.recv_bytes,
+             s_bench.copied_bytes, elapsed_us / 1e6);
+    ESP_LOGI(TAG, "throughput %.1f KB/s received, %.1f KB/s written",
+             s_bench.recv_bytes / 1024.0 / (elapsed_us / 1e6),
+             (s_bench.recv_bytes + s_bench.copied_bytes) / 1024.0 / (elapsed_us / 1e6));
+    ESP_LOGI(TAG, "per sector: wait %.2f ms avg / %.2f max, write %.2f ms avg / %.2f max",
+             s_bench.wait_us / 1e3 / MAX(1, s_bench.recv_sectors), s_bench.max_wait_us / 1e3,
+             s_bench.write_us / 1e3 / s_bench.sectors, s_bench.max_write_us / 1e3);
+    ESP_LOGI(TAG, "ms     <1     <2     <5    <10    <20    <50   <100   <200  >=200");
+    hist_log("wait", s_bench.wait_hist);
+    hist_log("write", s_bench.write_hist);
+
+#if BENCH_CPU_LOAD
+    configRUN_TIME_COUNTER_TYPE idle[configNUMBER_OF_CORES];
+    configRUN_TIME_COUNTER_TYPE total;
+    cpu_snapshot(idle, &total);
+    configRUN_TIME_COUNTER_TYPE span = total - s_bench.total;
+    for (BaseType_t core = 0; span && core < configNUMBER_OF_CORES; core++) {
+        ESP_LOGI(TAG, "core %d load %.1f%%", core, 100.0 - 100.0 * (idle[core] - s_bench.idle[core]) / span);
+    }
+#elif !CONFIG_IDF_TARGET_LINUX
+    ESP_LOGI(TAG, "CPU load needs FREERTOS_GENERATE_RUN_TIME_STATS and FREERTOS_USE_TRACE_FACILITY");
+#endif
+}
+
+#endif /* CONFIG_OTA_HELPER_BENCH_REPORT */
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// Session statistics for benchmark builds (CONFIG_OTA_HELPER_BENCH_REPORT),
+// fed by ota_task and logged when the session ends.
+
+int64_t ota_bench_now_us(void);
+
+// First image bytes are about to be read from the queue.
+void ota_bench_begin(void);
+
+// One sector done: time blocked on the transport and time in the sink.
+// `copied` sectors came from the running slot (sector diff), not the transport.
+void ota_bench_sector(size_t bytes, int64_t wait_us, int64_t write_us, bool copied);
+
+void ota_bench_end(esp_err_t err);
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "bootloader_common.h"
+#include "ota_boot.h"
+
+#if CONFIG_OTA_HELPER_BOOT_PROFILE
+
+static const char *TAG = "OTA_BOOT";
+
+// The bootloader phases come from bootloader_components/ota_boot_hooks, in
+// CPU cycles at whatever clock was running (as the bootloader log stamps).
+// Everything from APP_START on is esp_timer time, which on SYSTIMER targets
+// such as the ESP32-S3 counts from the chip reset as well.
+_Static_assert(sizeof(ota_boot_rtc_t) <= CONFIG_BOOTLOADER_CUSTOM_RESERVE_RTC_SIZE,
+               "BOOTLOADER_CUSTOM_RESERVE_RTC_SIZE too small for the boot profile");
+
+#define BOOT_EXPORT_VERSION                 1
+#define BOOT_FLAG_UPDATED                   0x01
+#define BOOT_FLAG_BOOTLOADER                0x02
+#define BOOT_UNSET                          UINT32_MAX
+#define BOOT_NOTE_MAGIC                     0x4f54414e
+
+static const char *s_names[OTA_BOOT_MILESTONES] = {
+    "bootloader", "image load", "app start", "app_main", "nvs", "app tasks", "ble", "first action",
+};
+
+// survives esp_restart(): set right before the post-update restart
+static RTC_NOINIT_ATTR uint32_t s_update_note;
+
+static struct {
+    uint32_t us[OTA_BOOT_MILESTONES];
+    uint8_t flags;
+} s_boot;
+static portMUX_TYPE s_boot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+__attribute__((constructor)) static void
+boot_profile_start(void)
+{
+    const ota_boot_rtc_t *rec = (const ota_boot_rtc_t *)bootloader_common_get_rtc_retain_mem()->custom;
+
+    for (int i = 0; i < OTA_BOOT_MILESTONES; i++) {
+        s_boot.us[i] = BOOT_UNSET;
+    }
+    s_boot.us[OTA_BOOT_APP_START] = esp_timer_get_time();
+    // the bootloader hooks zero the magic before stamping, so a record from an
+    // earlier boot never passes for this one
+    if (rec->magic == OTA_BOOT_RTC_MAGIC) {
+        s_boot.us[OTA_BOOT_BOOTLOADER] = rec->bootloader_us;
+        s_boot.us[OTA_BOOT_IMAGE_LOAD] = rec->image_load_us;
+        s_boot.flags |= BOOT_FLAG_BOOTLOADER;
+    }
+    if (s_update_note == BOOT_NOTE_MAGIC) {
+        s_boot.flags |= BOOT_FLAG_UPDATED;
+    }
+    s_update_note = 0;
+}
+
+static void
+boot_report(void)
+{
+    uint32_t prev = 0;
+
+    ESP_LOGI(TAG, "%s, reset reason %d", (s_boot.flags & BOOT_FLAG_UPDATED) ? "first boot after an update" : "boot",
+             esp_reset_reason());
+    for (int i = 0; i < OTA_BOOT_MILESTONES; i++) {
+        if (s_boot.us[i] == BOOT_UNSET) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-13s %8.1f ms  (+%.1f)", s_names[i], s_boot.us[i] / 1000.0, (s_boot.us[i] - prev) / 1000.0);
+        prev = s_boot.us[i];
+    }
+}
+
+void
+ota_boot_mark(ota_boot_milestone_t m)
+{
+    uint32_t now = esp_timer_get_time();
+    bool first;
+
+    if (m >= OTA_BOOT_MILESTONES) {
+        return;
+    }
+    portENTER_CRITICAL(&s_boot_lock);
+    first = s_boot.us[m] == BOOT_UNSET;
+    if (first) {
+        s_boot.us[m] = now;
+    }
+    portEXIT_CRITICAL(&s_boot_lock);
+
+    if (first && m == OTA_BOOT_FIRST_ACTION) {
+        boot_report();
+    }
+}
+
+void
+ota_boot_note_update(void)
+{
+    s_update_note = BOOT_NOTE_MAGIC;
+}
+
+size_t
+ota_boot_export(uint8_t *buf, size_t cap)
+{
+    size_t len = 4 + OTA_BOOT_MILESTONES * 4;
+
+    if (cap < len) {
+        return 0;
+    }
+    buf[0] = BOOT_EXPORT_VERSION;
+    buf[1] = s_boot.flags;
+    buf[2] = esp_reset_reason();
+    buf[3] = OTA_BOOT_MILESTONES;
+    portENTER_CRITICAL(&s_boot_lock);
+    for (int i = 0; i < OTA_BOOT_MILESTONES; i++) {
+        uint32_t v = s_boot.us[i];
+        buf[4 + i * 4] = v;
+        buf[5 + i * 4] = v >> 8;
+        buf[6 + i * 4] = v >> 16;
+        buf[7 + i * 4] = v >> 24;
+    }
+    portEXIT_CRITICAL(&s_boot_lock);
+    return len;
+}
+
+#endif /* CONFIG_OTA_HELPER_BOOT_PROFILE */
@@ -0,0 +1,471 @@
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "freertos/semphr.h"
+
+#include "ota_core.h"
+#include "ota_helper.h"
+#include "ota_bench.h"
+#include "ota_arena.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+
+// a raw sink replaces esp_ota_write in the benchmark sinks
+#define OTA_RAW_SINK                        (!CONFIG_OTA_HELPER_SINK_FULL)
+
+static const char *TAG = "OTA_CORE";
+
+#define OTA_TASK_SIZE                       8192
+#define OTA_SECTOR_SIZE                     4096
+// queue of a board without PSRAM, also the fallback for a deep queue
+#define OTA_QUEUE_INTERNAL_SIZE             8192
+
+SemaphoreHandle_t notify_sem     = NULL;
+static RingbufHandle_t s_ringbuf = NULL;
+static bool is_ota_started       = false;
+static const ota_core_hooks_t *s_hooks;
+static uint32_t s_ringbuf_size;
+static uint32_t s_queue_size;
+// ota_core_write() calls between their s_ringbuf check and the send
+static volatile int s_writers;
+static portMUX_TYPE s_write_lock = portMUX_INITIALIZER_UNLOCKED;
+// queue high watermark and sends refused for lack of room, per session
+static uint32_t s_queue_peak;
+static uint32_t s_queue_full;
+// set by ota_core_abort(), ota_task ends the session at its next receive
+static volatile bool s_abort;
+// image length of the session's diff plan, 0 without one
+static uint32_t s_plan_len;
+
+/* ------------------------------ flash sink --------------------------------------- */
+static const esp_partition_t *s_running;
+static const esp_partition_t *s_next;
+
+#if OTA_RAW_SINK
+// The scratch sink writes the inactive slot raw, erasing each sector on its
+// first write, and the caller checks the result; the discard sink stops after
+// the queue. Neither switches the boot partition.
+static esp_err_t
+sink_begin(void)
+{
+    s_running = esp_ota_get_running_partition();
+    s_next = esp_ota_get_next_update_partition(NULL);
+    return s_running && s_next ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// every sector is written from its start, whole when copied and in queue
+// pieces when received, so the first write of a sector erases it
+static esp_err_t
+sink_write(uint32_t offset, const void *data, size_t len)
+{
+#if CONFIG_OTA_HELPER_SINK_DISCARD
+    return ESP_OK;
+#else
+    esp_err_t err = ESP_OK;
+
+    if (offset % OTA_SECTOR_SIZE == 0) {
+        err = esp_partition_erase_range(s_next, offset, OTA_SECTOR_SIZE);
+    }
+    if (err == ESP_OK) {
+        err = esp_partition_write(s_next, offset, data, len);
+    }
+    return err;
+#endif
+}
+
+static esp_err_t
+sink_end(void)
+{
+    return ESP_OK;
+}
+#else
+esp_ota_handle_t out_handle = 0;
+
+static esp_err_t
+sink_begin(void)
+{
+    s_running = esp_ota_get_running_partition();
+    if (!s_running) {
+        ESP_LOGE(TAG, "get running partition failed!");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // rollback -> valid state 전환
+    esp_ota_img_states_t ota_state;
+    if (esp_ota_get_state_partition(s_running, &ota_state) == ESP_OK) {
+        if (ota_state == ESP_OTA_IMG_PENDING_VERIFY) {
+            ESP_ERROR_CHECK(esp_ota_mark_app_valid_cancel_rollback());
+            ESP_LOGI(TAG, "Marked running image as valid");
+        }
+    } else {
+        ESP_LOGE(TAG, "Failed to get OTA state for running partition!");
+        return ESP_FAIL;
+    }
+
+    if (s_running->type != ESP_PARTITION_TYPE_APP) {
+        ESP_LOGE(TAG, "running partition is not app type!");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_running->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0) {
+        s_next = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+    } else if (s_running->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_1) {
+        s_next = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    } else {
+        ESP_LOGE(TAG, "running partition subtype is not OTA subtype!");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!s_next) {
+        ESP_LOGE(TAG, "valid OTA partition not found!");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (esp_ota_begin(s_next, OTA_SIZE_UNKNOWN, &out_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed!");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// esp_ota_begin with OTA_SIZE_UNKNOWN erased the whole slot, so sectors can
+// land out of order: copied ones first, received ones after
+static esp_err_t
+sink_write(uint32_t offset, const void *data, size_t len)
+{
+    return esp_ota_write_with_offset(out_handle, data, len, offset);
+}
+
+static esp_err_t
+sink_end(void)
+{
+    if (esp_ota_end(out_handle) != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_end failed");
+        return ESP_FAIL;
+    }
+    if (esp_ota_set_boot_partition(s_next) != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+#endif
+
+// sector unchanged since the running firmware: copy it flash to flash instead of over the transport
+static esp_err_t
+copy_running_sector(uint8_t *buf, uint32_t offset, size_t len)
+{
+#if CONFIG_OTA_HELPER_SINK_DISCARD
+    return ESP_OK;
+#endif
+    esp_err_t err = esp_partition_read(s_running, offset, buf, len);
+    if (err == ESP_OK) {
+        err = sink_write(offset, buf, len);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "copy of running sector at 0x%" PRIx32 " failed: %s", offset, esp_err_to_name(err));
+    }
+    return err;
+}
+
+// Copies every sector of a diff plan that matches the running firmware before
+// the first received one is taken from the queue. Done lazily between received
+// sectors, a run of unchanged ones stalled progress past the app's sector
+// timeout; up front the queue and the transport backpressure absorb it.
+static esp_err_t
+copy_unchanged_sectors(uint8_t *buf, uint32_t image_len)
+{
+    uint16_t copied = 0;
+    esp_err_t err = ESP_OK;
+
+    for (uint32_t offset = 0; offset < image_len; offset += OTA_SECTOR_SIZE) {
+        uint16_t sector = offset / OTA_SECTOR_SIZE;
+        size_t len = MIN(OTA_SECTOR_SIZE, image_len - offset);
+
+        if (!s_hooks->sector_unchanged(sector)) {
+            continue;
+        }
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+        int64_t t0 = ota_bench_now_us();
+#endif
+        if ((err = copy_running_sector(buf, offset, len)) != ESP_OK) {
+            return err;
+        }
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+        ota_bench_sector(len, 0, ota_bench_now_us() - t0, true);
+#endif
+        copied++;
+    }
+    ESP_LOGI(TAG, "diff OTA: %u unchanged sectors copied", copied);
+    return err;
+}
+
+/* ------------------------------ session memory ----------------------------------- */
+// Everything below lives in the session arena; ota_task's stack is the only
+// other allocation and the kernel frees it when the task deletes itself.
+// It stays in internal RAM: flash writes run with the cache, and with it
+// PSRAM, disabled.
+// The sector copy buffer is only budgeted for a diff plan, which the phone
+// commits before the session starts.
+static size_t
+session_arena_size(uint32_t queue_size, bool diff)
+{
+    return ota_arena_footprint(sizeof(StaticRingbuffer_t)) + ota_arena_footprint(queue_size) +
+           ota_arena_footprint(sizeof(StaticSemaphore_t)) + (diff ? ota_arena_footprint(OTA_SECTOR_SIZE) : 0);
+}
+
+static bool
+session_alloc(uint32_t queue_size)
+{
+    // read once: the arena and ota_task go by the same plan
+    s_plan_len = s_hooks->plan_image_len ? s_hooks->plan_image_len() : 0;
+    if (!ota_arena_create(session_arena_size(queue_size, s_plan_len != 0))) {
+        return false;
+    }
+    StaticRingbuffer_t *rb = ota_arena_alloc(sizeof(StaticRingbuffer_t));
+    uint8_t *storage = ota_arena_alloc(queue_size);
+    StaticSemaphore_t *sem = ota_arena_alloc(sizeof(StaticSemaphore_t));
+    if (!rb || !storage || !sem) {
+        ota_arena_destroy();
+        return false;
+    }
+    s_queue_size = queue_size;
+    s_queue_peak = 0;
+    s_queue_full = 0;
+    s_abort = false;
+    s_ringbuf = xRingbufferCreateStatic(queue_size, RINGBUF_TYPE_BYTEBUF, storage, rb);
+    notify_sem = xSemaphoreCreateCountingStatic(100, 0, sem);
+    xSemaphoreGive(notify_sem);
+    return true;
+}
+
+// Stop taking transport bytes, wait for sends already past the check, then
+// hand the whole arena back. A sender blocked on a full queue holds this up
+// for at most its own timeout.
+static void
+session_release(void)
+{
+    taskENTER_CRITICAL(&s_write_lock);
+    RingbufHandle_t rb = s_ringbuf;
+    s_ringbuf = NULL;
+    taskEXIT_CRITICAL(&s_write_lock);
+    while (s_writers) {
+        vTaskDelay(1);
+    }
+    ESP_LOGI(TAG, "sector queue: peak %" PRIu32 " of %" PRIu32 " B, %" PRIu32 " writes refused", s_queue_peak,
+             s_queue_size, s_queue_full);
+    vRingbufferDelete(rb);
+    vSemaphoreDelete(notify_sem);
+    notify_sem = NULL;
+    ota_arena_destroy();
+}
+
+/* ------------------------------ ota_task ----------------------------------------- */
+void
+ota_task(void *arg)
+{
+    uint32_t recv_len = 0;     // bytes received over the transport
+    uint32_t written_len = 0;  // bytes written to the new partition, including copied sectors
+    uint8_t *data = NULL;
+    uint8_t *copy_buf = NULL;  // sector bounce buffer from the arena, only with a diff plan
+    size_t item_size = 0;
+    esp_err_t err = ESP_FAIL;
+
+    ESP_LOGI(TAG, "ota_task start");
+
+    if ((err = sink_begin()) != ESP_OK) {
+        goto OTA_ERROR;
+    }
+
+    // task를 늦게 등록해서 fw_length에 이미 길이 값이 설정
+    uint32_t ota_total_len = s_hooks->fw_length();
+    ESP_LOGI(TAG, "OTA total length: %" PRIu32 " bytes", ota_total_len);
+    if (ota_total_len <= 0) {
+        ESP_LOGE(TAG, "OTA total length is zero, aborting OTA process.");
+        err = ESP_ERR_INVALID_SIZE;
+        goto OTA_ERROR;
+    }
+
+    /*deal with all receive packet*/
+    // with a diff plan the image is longer than what crosses the transport:
+    // sectors that match the running firmware are copied locally first and
+    // received ones are written at their image offset
+    uint32_t image_len = ota_total_len;
+    uint8_t progress = 0;
+    uint32_t plan_len = s_plan_len;
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+    int64_t t0, wait_us, write_us;
+    ota_bench_begin();
+#endif
+    if (plan_len) {
+        image_len = plan_len;
+        ESP_LOGI(TAG, "diff OTA: image %" PRIu32 " bytes, %" PRIu32 " transferred", image_len, ota_total_len);
+        if (!(copy_buf = ota_arena_alloc(OTA_SECTOR_SIZE))) {
+            err = ESP_ERR_NO_MEM;
+            goto OTA_ERROR;
+        }
+        if ((err = copy_unchanged_sectors(copy_buf, image_len)) != ESP_OK) {
+            goto OTA_ERROR;
+        }
+    }
+    for (uint16_t sector = 0; written_len < image_len; sector++) {
+        size_t sector_len = MIN(OTA_SECTOR_SIZE, image_len - written_len);
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+        wait_us = 0;
+        write_us = 0;
+#endif
+
+        if (plan_len && s_hooks->sector_unchanged(sector)) {
+            written_len += sector_len;
+            continue;
+        }
+        // transports hand over whole sectors, but a BYTEBUF item can be split at the wrap point
+        for (size_t got = 0; got < sector_len; got += item_size) {
+            if (s_abort) {
+                ESP_LOGE(TAG, "Session aborted by the transport");
+                err = ESP_ERR_INVALID_STATE;
+                goto OTA_ERROR;
+            }
+            // ota task will block here until data is available in the ring buffer
+            // max delay set to 10 seconds
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+            t0 = ota_bench_now_us();
+#endif
+            data = (uint8_t *)xRingbufferReceiveUpTo(s_ringbuf, &item_size, (TickType_t)pdMS_TO_TICKS(10000), sector_len - got);
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+            wait_us += ota_bench_now_us() - t0;
+#endif
+            // timeout occurred
+            if (!data) {
+                ESP_LOGE(TAG, "Timeout waiting for data in ring buffer");
+                err = ESP_ERR_TIMEOUT;
+                goto OTA_ERROR;
+            }
+
+            // take the semaphore (timeout 10 seconds)
+            if (xSemaphoreTake(notify_sem, pdMS_TO_TICKS(10000)) != pdTRUE) {
+                vRingbufferReturnItem(s_ringbuf, (void *)data);
+                ESP_LOGE(TAG, "Failed to take semaphore for OTA operation");
+                err = ESP_ERR_TIMEOUT;
+                goto OTA_ERROR;
+            }
+
+            // write data to OTA partition and return the item to the ring buffer
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+            t0 = ota_bench_now_us();
+#endif
+            err = sink_write(written_len + got, data, item_size);
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+            write_us += ota_bench_now_us() - t0;
+#endif
+            vRingbufferReturnItem(s_ringbuf, (void *)data);
+            // release the semaphore for next iteration
+            xSemaphoreGive(notify_sem);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "esp_ota_write failed");
+                goto OTA_ERROR;
+            }
+        }
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+        ota_bench_sector(sector_len, wait_us, write_us, false);
+#endif
+        written_len += sector_len;
+        recv_len += sector_len;
+        ESP_LOGI(TAG, "recv: %u, recv_total:%"PRIu32", total:%"PRIu32"\n", (unsigned)sector_len, recv_len, ota_total_len);
+
+        progress = ((uint64_t)recv_len * 100) / ota_total_len;
+        s_hooks->progress(progress);
+        ESP_LOGI(TAG, "Sent progress: %d%%", progress);
+    }
+    if (progress < 100) {
+        s_hooks->progress(100);
+    }
+    ESP_LOGI(TAG, "OTA flash upload success, total length: %" PRIu32 " (%" PRIu32 " transferred)", written_len, recv_len);
+
+    err = sink_end();
+
+OTA_ERROR:
+#if CONFIG_OTA_HELPER_BENCH_REPORT
+    ota_bench_end(err);
+#endif
+#if !CONFIG_IDF_TARGET_LINUX
+    ESP_LOGI(TAG, "ota_task stack: %u of %d B never used", (unsigned)uxTaskGetStackHighWaterMark(NULL), OTA_TASK_SIZE);
+#endif
+    session_release();
+    s_hooks->finished(err);
+    vTaskDelete(NULL);
+}
+
+/* ------------------------------ API ---------------------------------------------- */
+bool
+ota_core_init(uint32_t ringbuf_size, const ota_core_hooks_t *hooks)
+{
+    s_hooks = hooks;
+    s_ringbuf_size = ringbuf_size;
+    return hooks != NULL && ringbuf_size > 0;
+}
+
+bool
+ota_core_start(void)
+{
+    if (is_ota_started) {
+        return false;
+    }
+    // the queue and its companions only exist for a session
+    bool ok = session_alloc(s_ringbuf_size);
+    if (!ok && s_ringbuf_size > OTA_QUEUE_INTERNAL_SIZE) {
+        ESP_LOGW(TAG, "%" PRIu32 " B sector queue unavailable, using %d B", s_ringbuf_size, OTA_QUEUE_INTERNAL_SIZE);
+        ok = session_alloc(OTA_QUEUE_INTERNAL_SIZE);
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "Failed to allocate the OTA session (%" PRIu32 " B sector queue)", s_ringbuf_size);
+        return false;
+    }
+    if (xTaskCreate(ota_task, "ota_task", OTA_TASK_SIZE, NULL, 10, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create OTA task");
+        session_release();
+        return false;
+    }
+    is_ota_started = true;
+    return true;
+}
+
+bool
+ota_core_started(void)
+{
+    return is_ota_started;
+}
+
+bool
+ota_core_write(const uint8_t *data, size_t len, TickType_t wait)
+{
+    if (s_abort) {
+        return false;
+    }
+    taskENTER_CRITICAL(&s_write_lock);
+    RingbufHandle_t rb = s_ringbuf;
+    s_writers += rb != NULL;
+    taskEXIT_CRITICAL(&s_write_lock);
+    if (!rb) {
+        ESP_LOGE(TAG, "Ring buffer not initialized");
+        return false;
+    }
+    bool sent = xRingbufferSend(rb, (void *)data, len, wait) == pdTRUE;
+    uint32_t queued = s_queue_size - xRingbufferGetCurFreeSize(rb);
+    taskENTER_CRITICAL(&s_write_lock);
+    s_writers--;
+    s_queue_peak = MAX(s_queue_peak, queued);
+    s_queue_full += !sent;
+    taskEXIT_CRITICAL(&s_write_lock);
+    return sent;
+}
+
+void
+ota_core_abort(void)
+{
+    s_abort = true;
+}
@@ -0,0 +1,618 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "host/ble_hs.h"
+#include "host/ble_gap.h"
+#include "host/ble_gatt.h"
+#include "psa/crypto.h"
+#include "esp_rom_crc.h"
+
+#include "ota_ctrl.h"
+#include "ota_wifi.h"
+#include "ota_stream.h"
+#include "ota_boot.h"
+
+static const char *TAG = "OTA_CTRL";
+
+#define OTA_CTRL_SECTOR_SIZE                4096
+#define OTA_CTRL_HASH_LEN                   32
+#define OTA_CTRL_SYNC_TIMEOUT_MS            3000
+
+// control char opcodes, replies echo the opcode with the top bit set
+#define OTA_CTRL_OP_DIFF_HASH               0x01
+#define OTA_CTRL_OP_DIFF_COMMIT             0x02
+#define OTA_CTRL_OP_DIFF_CLEAR              0x03
+#define OTA_CTRL_OP_WIFI_CAPS               0x04
+#define OTA_CTRL_OP_WIFI_START              0x05
+#define OTA_CTRL_OP_SECTOR_CRC32            0x06
+#define OTA_CTRL_OP_LINK_INFO               0x07
+#define OTA_CTRL_REPLY                      0x80
+
+#define OTA_CTRL_OK                         0x00
+#define OTA_CTRL_ERR_REQUEST                0x01
+#define OTA_CTRL_ERR_ORDER                  0x02
+#define OTA_CTRL_ERR_SIZE                   0x03
+#define OTA_CTRL_ERR_FLASH                  0x04
+#define OTA_CTRL_ERR_BUSY                   0x05
+#define OTA_CTRL_ERR_WIFI                   0x06
+
+// CRC32 sector char: ble_ota's RECV_FW framing and acks, plus BUSY when the
+// sector could not be queued (RECV_FW drops it silently)
+#define OTA_SECTOR_SEQ_LAST                 0xFF
+#define OTA_SECTOR_ACK_LEN                  20
+#define OTA_SECTOR_ACK_OK                   0x0000
+#define OTA_SECTOR_ACK_CRC_ERROR            0x0001
+#define OTA_SECTOR_ACK_INDEX_ERROR          0x0002
+#define OTA_SECTOR_ACK_BUSY                 0x0004
+
+static const ble_uuid16_t s_ctrl_svc_uuid = BLE_UUID16_INIT(0x8030);
+static const ble_uuid16_t s_ctrl_chr_uuid = BLE_UUID16_INIT(0x8031);
+static const ble_uuid16_t s_info_chr_uuid = BLE_UUID16_INIT(0x8032);
+static uint16_t s_ctrl_val_handle;
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+static const ble_uuid16_t s_sector32_chr_uuid = BLE_UUID16_INIT(0x8033);
+static uint16_t s_sector32_val_handle;
+#endif
+#if CONFIG_OTA_HELPER_BOOT_PROFILE
+static const ble_uuid16_t s_boot_chr_uuid = BLE_UUID16_INIT(0x8034);
+#endif
+
+// sector diff plan, built by DIFF_HASH in sector order and armed by DIFF_COMMIT
+static struct {
+    bool active;
+    uint32_t image_len;
+    uint16_t hashed;   // sectors compared so far
+    uint16_t changed;
+    uint16_t conn;     // link that negotiated it, the plan goes with it
+    uint8_t bitmap[OTA_CTRL_MAX_SECTORS / 8]; // 1 = differs from the running firmware
+} s_plan = { .conn = BLE_HS_CONN_HANDLE_NONE };
+
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+// sector being reassembled from CRC32 sector char writes
+static struct {
+    uint16_t sector;   // next sector index expected
+    uint8_t seq;       // next packet expected within it
+    bool corrupt;
+    size_t len;
+    uint16_t conn;     // link that asked for CRC32 sectors
+    uint8_t *buf;      // allocated once the session starts, freed with the link
+} s_rx = { .conn = BLE_HS_CONN_HANDLE_NONE };
+#endif
+
+static inline uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+static void
+chr_notify(uint16_t conn_handle, uint16_t val_handle, const uint8_t *data, size_t len)
+{
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+    if (!om || ble_gatts_notify_custom(conn_handle, val_handle, om) != 0) {
+        ESP_LOGW(TAG, "notify on 0x%04x failed", val_handle);
+    }
+}
+
+static void
+ctrl_notify(uint16_t conn_handle, const uint8_t *data, size_t len)
+{
+    chr_notify(conn_handle, s_ctrl_val_handle, data, len);
+}
+
+static void
+plan_reset(void)
+{
+    memset(&s_plan, 0, sizeof(s_plan));
+    s_plan.conn = BLE_HS_CONN_HANDLE_NONE;
+}
+
+// true if `sector` of the new image (hash `expected`) differs from the running partition
+static bool
+sector_differs(const esp_partition_t *running, uint8_t *buf, uint16_t sector, const uint8_t *expected,
+               esp_err_t *err)
+{
+    uint32_t off = (uint32_t)sector * OTA_CTRL_SECTOR_SIZE;
+    size_t len = MIN(OTA_CTRL_SECTOR_SIZE, s_plan.image_len - off);
+    uint8_t hash[OTA_CTRL_HASH_LEN];
+    size_t hash_len = 0;
+
+    if (off + len > running->size) {
+        return true;
+    }
+    *err = esp_partition_read(running, off, buf, len);
+    if (*err != ESP_OK) {
+        return true;
+    }
+    if (psa_hash_compute(PSA_ALG_SHA_256, buf, len, hash, sizeof(hash), &hash_len) != PSA_SUCCESS) {
+        *err = ESP_FAIL;
+        return true;
+    }
+    return memcmp(hash, expected, OTA_CTRL_HASH_LEN) != 0;
+}
+
+// [op][image_len u32][first u16][n u8][n x sha256] -> [op|0x80][status][first u16][n u8][mask]
+static void
+handle_diff_hash(uint16_t conn_handle, const uint8_t *req, size_t len)
+{
+    uint8_t reply[5 + 32] = { OTA_CTRL_REPLY | OTA_CTRL_OP_DIFF_HASH, OTA_CTRL_OK };
+    size_t reply_len = 5;
+
+    if (len < 8) {
+        reply[1] = OTA_CTRL_ERR_REQUEST;
+        goto REPLY;
+    }
+    uint32_t image_len = get_u32(req + 1);
+    uint16_t first = get_u16(req + 5);
+    uint8_t n = req[7];
+    memcpy(reply + 2, req + 5, 3);
+
+    if (len != 8 + (size_t)n * OTA_CTRL_HASH_LEN) {
+        reply[1] = OTA_CTRL_ERR_REQUEST;
+        goto REPLY;
+    }
+    if (first == 0) {
+        plan_reset();
+        s_plan.image_len = image_len;
+        s_plan.conn = conn_handle;
+    }
+    if (first != s_plan.hashed || image_len != s_plan.image_len) {
+        reply[1] = OTA_CTRL_ERR_ORDER;
+        goto REPLY;
+    }
+    if ((uint32_t)first + n > OTA_CTRL_MAX_SECTORS ||
+        ((uint32_t)first + n) * OTA_CTRL_SECTOR_SIZE >= image_len + OTA_CTRL_SECTOR_SIZE) {
+        reply[1] = OTA_CTRL_ERR_SIZE;
+        goto REPLY;
+    }
+
+    // only needed while a batch is hashed
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    uint8_t *buf = malloc(OTA_CTRL_SECTOR_SIZE);
+    if (!buf) {
+        reply[1] = OTA_CTRL_ERR_BUSY;
+        goto REPLY;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        uint16_t sector = first + i;
+        esp_err_t err = ESP_OK;
+        if (sector_differs(running, buf, sector, req + 8 + i * OTA_CTRL_HASH_LEN, &err)) {
+            s_plan.bitmap[sector / 8] |= 1 << (sector % 8);
+            s_plan.changed++;
+            reply[5 + i / 8] |= 1 << (i % 8);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "hashing running sector %u failed: %s", sector, esp_err_to_name(err));
+            reply[1] = OTA_CTRL_ERR_FLASH;
+            free(buf);
+            goto REPLY;
+        }
+    }
+    free(buf);
+    s_plan.hashed += n;
+    reply_len += (n + 7) / 8;
+
+REPLY:
+    ctrl_notify(conn_handle, reply, reply_len);
+}
+
+// [op][image_len u32][sector_count u16] -> [op|0x80][status][changed u16]
+static void
+handle_diff_commit(uint16_t conn_handle, const uint8_t *req, size_t len)
+{
+    uint8_t reply[4] = { OTA_CTRL_REPLY | OTA_CTRL_OP_DIFF_COMMIT, OTA_CTRL_OK };
+
+    if (len != 7) {
+        reply[1] = OTA_CTRL_ERR_REQUEST;
+    } else if (get_u32(req + 1) != s_plan.image_len || get_u16(req + 5) != s_plan.hashed ||
+               s_plan.hashed == 0) {
+        reply[1] = OTA_CTRL_ERR_ORDER;
+    } else {
+        s_plan.active = true;
+        ESP_LOGI(TAG, "diff plan: %u of %u sectors changed, image %" PRIu32 " bytes",
+                 s_plan.changed, s_plan.hashed, s_plan.image_len);
+    }
+    reply[2] = s_plan.changed & 0xFF;
+    reply[3] = s_plan.changed >> 8;
+    ctrl_notify(conn_handle, reply, sizeof(reply));
+}
+
+// [op] -> [op|0x80][status][itvl u16][latency u16][timeout u16][tx_phy u8][rx_phy u8]
+// The link as the central granted it (1.25 ms and 10 ms units, BLE_HCI_LE_PHY_*),
+// which the app cannot learn from its own OS.
+static void
+handle_link_info(uint16_t conn_handle)
+{
+    uint8_t reply[10] = { OTA_CTRL_REPLY | OTA_CTRL_OP_LINK_INFO, OTA_CTRL_OK };
+    struct ble_gap_conn_desc desc;
+    uint8_t tx_phy = BLE_HCI_LE_PHY_1M;
+    uint8_t rx_phy = BLE_HCI_LE_PHY_1M;
+
+    if (ble_gap_conn_find(conn_handle, &desc) != 0) {
+        reply[1] = OTA_CTRL_ERR_REQUEST;
+        ctrl_notify(conn_handle, reply, 2);
+        return;
+    }
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    if (ble_gap_read_le_phy(conn_handle, &tx_phy, &rx_phy) != 0) {
+        tx_phy = rx_phy = BLE_HCI_LE_PHY_1M;
+    }
+#endif
+    reply[2] = desc.conn_itvl & 0xFF;
+    reply[3] = desc.conn_itvl >> 8;
+    reply[4] = desc.conn_latency & 0xFF;
+    reply[5] = desc.conn_latency >> 8;
+    reply[6] = desc.supervision_timeout & 0xFF;
+    reply[7] = desc.supervision_timeout >> 8;
+    reply[8] = tx_phy;
+    reply[9] = rx_phy;
+    ctrl_notify(conn_handle, reply, sizeof(reply));
+}
+
+#if CONFIG_OTA_HELPER_WIFI
+// Wi-Fi credentials only cross an encrypted link. WIFI_CAPS, which the app
+// sends first, is refused the same way, so the phone pairs before it sends them.
+static bool
+link_encrypted(uint16_t conn_handle)
+{
+    struct ble_gap_conn_desc desc;
+
+    return ble_gap_conn_find(conn_handle, &desc) == 0 && desc.sec_state.encrypted;
+}
+
+// answered from the Wi-Fi task once the download runs or has failed
+static void
+wifi_ready(esp_err_t err, uint32_t ip4, void *arg)
+{
+    uint8_t reply[6] = { OTA_CTRL_REPLY | OTA_CTRL_OP_WIFI_START, err == ESP_OK ? OTA_CTRL_OK : OTA_CTRL_ERR_WIFI };
+
+    memcpy(reply + 2, &ip4, sizeof(ip4));
+    ctrl_notify((uint16_t)(uintptr_t)arg, reply, sizeof(reply));
+}
+
+// [op][mode u8][image_len u32][ssid_len u8][ssid][pass_len u8][pass][url] -> [op|0x80][status][ipv4]
+static void
+handle_wifi_start(uint16_t conn_handle, const uint8_t *req, size_t len)
+{
+    uint8_t reply[6] = { OTA_CTRL_REPLY | OTA_CTRL_OP_WIFI_START, OTA_CTRL_ERR_REQUEST };
+    static ota_wifi_req_t w;
+    size_t pos = 7;
+
+    memset(&w, 0, sizeof(w));
+    if (len < pos) {
+        goto REPLY;
+    }
+    w.mode = req[1];
+    w.image_len = get_u32(req + 2);
+    uint8_t ssid_len = req[6];
+    if (ssid_len >= sizeof(w.ssid) || pos + ssid_len + 1 > len) {
+        goto REPLY;
+    }
+    memcpy(w.ssid, req + pos, ssid_len);
+    pos += ssid_len;
+    uint8_t pass_len = req[pos++];
+    if (pass_len >= sizeof(w.password) || pos + pass_len > len || len - pos - pass_len >= sizeof(w.url)) {
+        goto REPLY;
+    }
+    memcpy(w.password, req + pos, pass_len);
+    pos += pass_len;
+    memcpy(w.url, req + pos, len - pos);
+
+    if (ota_wifi_start(&w, wifi_ready, (void *)(uintptr_t)conn_handle)) {
+        ESP_LOGI(TAG, "Wi-Fi OTA from %s via %s \"%s\"", w.url, w.mode == OTA_WIFI_MODE_STA ? "STA" : "SoftAP", w.ssid);
+        return;
+    }
+    reply[1] = OTA_CTRL_ERR_BUSY;
+
+REPLY:
+    ctrl_notify(conn_handle, reply, sizeof(reply));
+}
+#endif
+
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+static void
+rx_reset(void)
+{
+    free(s_rx.buf);
+    s_rx.buf = NULL;
+    s_rx.sector = 0;
+    s_rx.seq = 0;
+    s_rx.corrupt = false;
+    s_rx.len = 0;
+    s_rx.conn = BLE_HS_CONN_HANDLE_NONE;
+}
+
+// the reassembly buffer of a fresh session; the app may skip SECTOR_CRC32
+static bool
+rx_begin(void)
+{
+    if (!s_rx.buf) {
+        s_rx.buf = malloc(OTA_CTRL_SECTOR_SIZE);
+    }
+    return s_rx.buf != NULL;
+}
+
+// [sector u16][status u16][expected u16] ... [CRC16 of bytes 0..17], as ble_ota acks
+static void
+sector_ack(uint16_t conn_handle, uint16_t sector, uint16_t status)
+{
+    uint8_t ack[OTA_SECTOR_ACK_LEN] = {
+        sector & 0xFF, sector >> 8, status & 0xFF, status >> 8, s_rx.sector & 0xFF, s_rx.sector >> 8,
+    };
+    // the ROM routine inverts in and out; ble_ota's CRC16-CCITT does neither
+    uint16_t crc = ~esp_rom_crc16_be((uint16_t)~0, ack, OTA_SECTOR_ACK_LEN - 2);
+
+    ack[OTA_SECTOR_ACK_LEN - 2] = crc & 0xFF;
+    ack[OTA_SECTOR_ACK_LEN - 1] = crc >> 8;
+    chr_notify(conn_handle, s_sector32_val_handle, ack, sizeof(ack));
+}
+
+// [sector u16][seq u8][payload], seq 0xFF on the last packet of a sector,
+// which ends with the CRC32 (IEEE, as zlib) of the whole sector
+static int
+ota_sector32_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    static uint8_t pkt[512];
+    uint16_t len = 0;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, pkt, sizeof(pkt), &len) != 0 || len < 3) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    uint16_t sector = get_u16(pkt);
+    uint8_t seq = pkt[2];
+    bool last = seq == OTA_SECTOR_SEQ_LAST;
+
+    if (sector != s_rx.sector) {
+        if (last) {
+            sector_ack(conn_handle, sector, OTA_SECTOR_ACK_INDEX_ERROR);
+        }
+        return 0;
+    }
+    if (!rx_begin()) {
+        if (last) {
+            sector_ack(conn_handle, sector, OTA_SECTOR_ACK_BUSY);
+        }
+        return 0;
+    }
+    // the first packet of a resent sector starts it over
+    if (seq == 0) {
+        s_rx.len = 0;
+        s_rx.seq = 0;
+        s_rx.corrupt = false;
+    }
+    if (!last && seq != s_rx.seq) {
+        s_rx.corrupt = true;
+    }
+    s_rx.seq = last ? 0 : seq + 1;
+
+    size_t trailer = last ? sizeof(uint32_t) : 0;
+    size_t payload = len >= 3 + trailer ? len - 3 - trailer : 0;
+    if (len < 3 + trailer || s_rx.len + payload > OTA_CTRL_SECTOR_SIZE) {
+        s_rx.corrupt = true;
+    } else {
+        memcpy(s_rx.buf + s_rx.len, pkt + 3, payload);
+        s_rx.len += payload;
+    }
+    if (!last) {
+        return 0;
+    }
+
+    uint16_t status = OTA_SECTOR_ACK_OK;
+    if (s_rx.corrupt || esp_rom_crc32_le(0, s_rx.buf, s_rx.len) != get_u32(pkt + len - trailer)) {
+        status = OTA_SECTOR_ACK_CRC_ERROR;
+    } else if (!ota_stream_sector(s_rx.buf, s_rx.len)) {
+        status = OTA_SECTOR_ACK_BUSY;
+    } else {
+        s_rx.sector++;
+    }
+    s_rx.len = 0;
+    s_rx.corrupt = false;
+    sector_ack(conn_handle, sector, status);
+    return 0;
+}
+#endif
+
+static int
+ota_ctrl_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    static uint8_t req[512];
+    uint16_t len = 0;
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    if (ble_hs_mbuf_to_flat(ctxt->om, req, sizeof(req), &len) != 0 || len == 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    switch (req[0]) {
+    case OTA_CTRL_OP_DIFF_HASH:
+        handle_diff_hash(conn_handle, req, len);
+        break;
+    case OTA_CTRL_OP_DIFF_COMMIT:
+        handle_diff_commit(conn_handle, req, len);
+        break;
+    case OTA_CTRL_OP_DIFF_CLEAR: {
+        uint8_t reply[2] = { OTA_CTRL_REPLY | OTA_CTRL_OP_DIFF_CLEAR, OTA_CTRL_OK };
+        plan_reset();
+        ctrl_notify(conn_handle, reply, sizeof(reply));
+        break;
+    }
+#if CONFIG_OTA_HELPER_WIFI
+    case OTA_CTRL_OP_WIFI_CAPS: {
+        if (!link_encrypted(conn_handle)) {
+            return BLE_ATT_ERR_INSUFFICIENT_ENC;
+        }
+        uint8_t reply[3] = { OTA_CTRL_REPLY | OTA_CTRL_OP_WIFI_CAPS, OTA_CTRL_OK, ota_wifi_modes() };
+        ctrl_notify(conn_handle, reply, sizeof(reply));
+        break;
+    }
+    case OTA_CTRL_OP_WIFI_START:
+        if (!link_encrypted(conn_handle)) {
+            return BLE_ATT_ERR_INSUFFICIENT_ENC;
+        }
+        handle_wifi_start(conn_handle, req, len);
+        break;
+#endif
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+    // [op] -> [op|0x80][status]: sectors of the next session come on the CRC32 char
+    case OTA_CTRL_OP_SECTOR_CRC32: {
+        uint8_t reply[2] = { OTA_CTRL_REPLY | OTA_CTRL_OP_SECTOR_CRC32, OTA_CTRL_OK };
+        if (s_rx.sector != 0) {
+            reply[1] = OTA_CTRL_ERR_BUSY;
+        } else {
+            rx_reset();
+            // no memory for the sector buffer: the app stays on RECV_FW
+            if (!rx_begin()) {
+                reply[1] = OTA_CTRL_ERR_BUSY;
+            } else {
+                s_rx.conn = conn_handle;
+            }
+        }
+        ctrl_notify(conn_handle, reply, sizeof(reply));
+        break;
+    }
+#endif
+    case OTA_CTRL_OP_LINK_INFO:
+        handle_link_info(conn_handle);
+        break;
+    default:
+        ESP_LOGW(TAG, "unknown ctrl op 0x%02x", req[0]);
+        return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
+    }
+    return 0;
+}
+
+// running firmware's esp_app_desc_t as is (version, project, build time, ELF SHA-256),
+// so the app can skip a transfer of the image it already runs
+static int
+ota_info_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    const esp_app_desc_t *desc = esp_app_get_description();
+    return os_mbuf_append(ctxt->om, desc, sizeof(*desc)) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+#if CONFIG_OTA_HELPER_BOOT_PROFILE
+// this boot's profile (see ota_boot.h), to time the downtime of the last update
+static int
+ota_boot_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    uint8_t buf[4 + OTA_BOOT_MILESTONES * 4];
+
+    if (ctxt->op != BLE_GATT_ACCESS_OP_READ_CHR) {
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    size_t len = ota_boot_export(buf, sizeof(buf));
+    return os_mbuf_append(ctxt->om, buf, len) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+#endif
+
+static const struct ble_gatt_svc_def s_ctrl_svcs[] = {
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = &s_ctrl_svc_uuid.u,
+        .characteristics = (struct ble_gatt_chr_def[]) {
+            {
+                .uuid = &s_ctrl_chr_uuid.u,
+                .access_cb = ota_ctrl_access,
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &s_ctrl_val_handle,
+            },
+            {
+                .uuid = &s_info_chr_uuid.u,
+                .access_cb = ota_info_access,
+                .flags = BLE_GATT_CHR_F_READ,
+            },
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+            {
+                .uuid = &s_sector32_chr_uuid.u,
+                .access_cb = ota_sector32_access,
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &s_sector32_val_handle,
+            },
+#endif
+#if CONFIG_OTA_HELPER_BOOT_PROFILE
+            {
+                .uuid = &s_boot_chr_uuid.u,
+                .access_cb = ota_boot_access,
+                .flags = BLE_GATT_CHR_F_READ,
+            },
+#endif
+            { 0 },
+        },
+    },
+    { 0 },
+};
+
+bool
+ota_ctrl_init(void)
+{
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        ESP_LOGE(TAG, "psa_crypto_init failed");
+        return false;
+    }
+
+    // dynamic services can only be added once the host task has synced
+    for (int waited = 0; !ble_hs_synced(); waited += 10) {
+        if (waited >= OTA_CTRL_SYNC_TIMEOUT_MS) {
+            ESP_LOGE(TAG, "host did not sync");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    int rc = ble_gatts_add_dynamic_svcs(s_ctrl_svcs);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "adding ctrl service failed: %d", rc);
+        return false;
+    }
+    ESP_LOGI(TAG, "ctrl service registered");
+    return true;
+}
+
+void
+ota_ctrl_link_closed(uint16_t conn_handle)
+{
+    // relay links and other phones leave them alone
+    if (conn_handle == s_plan.conn) {
+        plan_reset();
+    }
+#if CONFIG_OTA_HELPER_SECTOR_CRC32
+    if (conn_handle == s_rx.conn) {
+        rx_reset();
+    }
+#endif
+}
+
+bool
+ota_ctrl_plan_active(void)
+{
+    return s_plan.active;
+}
+
+uint32_t
+ota_ctrl_plan_image_len(void)
+{
+    return s_plan.image_len;
+}
+
+bool
+ota_ctrl_sector_unchanged(uint16_t sector)
+{
+    if (!s_plan.active || sector >= s_plan.hashed) {
+        return false;
+    }
+    return !(s_plan.bitmap[sector / 8] & (1 << (sector % 8)));
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 8MB app partition / 4KB sectors
+#define OTA_CTRL_MAX_SECTORS                2048
+
+// Register the ota_helper control service next to ble_ota's. Needs a synced host.
+bool ota_ctrl_init(void);
+
+// Drop the sector diff plan and CRC32 sector state if `conn_handle` is the
+// link that set them up, e.g. when that phone disconnects before the transfer.
+void ota_ctrl_link_closed(uint16_t conn_handle);
+
+// Sector diff plan committed by the phone for the next transfer. When active,
+// only changed sectors arrive over ble_ota; the rest are copied from the
+// running partition by ota_task.
+bool ota_ctrl_plan_active(void);
+uint32_t ota_ctrl_plan_image_len(void);
+bool ota_ctrl_sector_unchanged(uint16_t sector);
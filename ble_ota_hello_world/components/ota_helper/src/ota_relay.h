@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "esp_app_desc.h"
+
+// Start the relay task: scan for peers running an older build of this
+// project and push the running image to them over ble_ota, as a central.
+bool ota_relay_start(void);
+
+// Stop relaying, e.g. because this device is itself receiving an update.
+void ota_relay_stop(void);
+
+// True when `app` is the same project as `than` at a strictly newer version.
+// Devices only ever take images that pass this, so two never push at each other.
+bool ota_relay_app_newer(const esp_app_desc_t *app, const esp_app_desc_t *than);
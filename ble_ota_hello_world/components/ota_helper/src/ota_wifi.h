@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define OTA_WIFI_MODE_STA                   0x01
+#define OTA_WIFI_MODE_SOFTAP                0x02
+
+typedef struct {
+    uint8_t mode;         // OTA_WIFI_MODE_*
+    uint32_t image_len;   // expected Content-Length, 0 = take the server's
+    char ssid[33];
+    char password[65];
+    char url[256];
+} ota_wifi_req_t;
+
+// Called once the image download has started (ESP_OK, our IPv4 address) or
+// failed before that; the caller answers the phone from here.
+typedef void (*ota_wifi_ready_cb_t)(esp_err_t err, uint32_t ip4, void *arg);
+
+// Modes this build supports, OTA_WIFI_MODE_* bits.
+uint8_t ota_wifi_modes(void);
+
+// Bring up Wi-Fi as a station or SoftAP and stream the image at req->url into
+// ota_task. BLE stays up for control and progress. Runs on its own task.
+bool ota_wifi_start(const ota_wifi_req_t *req, ota_wifi_ready_cb_t cb, void *arg);
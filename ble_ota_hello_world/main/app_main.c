@@ -8,6 +8,7 @@
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "ota_helper.h"
+#include "ota_boot.h"
 #include "hello_world.h"
 
 static const char *TAG = "APP_MAIN";
@@ -16,6 +17,7 @@ static const char *TAG = "APP_MAIN";
 
 void app_main(void)
 {
+    ota_boot_mark(OTA_BOOT_APP_MAIN);
     ESP_LOGI(TAG, "Initializing nvs flash");
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
@@ -24,10 +26,11 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    ota_boot_mark(OTA_BOOT_NVS);
 
     ESP_LOGI(TAG, "Initializing BLE OTA and Hello World task");
 
-    // Initialize BLE OTA
+    // BLE OTA: up now or after the application started, see OTA_HELPER_BRINGUP
     if (!ble_ota_helper_init()) {
         ESP_LOGE(TAG, "Failed to initialize BLE OTA");
         esp_restart();
@@ -40,6 +43,9 @@ void app_main(void)
         ESP_LOGE(TAG, "Failed to create hello_world_task");
         esp_restart();
     }
+    ota_boot_mark(OTA_BOOT_APP_TASKS);
+    // hello_world_task is all this application does
+    ota_boot_mark(OTA_BOOT_FIRST_ACTION);
 
     ESP_LOGI(TAG, "System initialization complete");
 
@@ -0,0 +1,70 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Platform } from 'react-native';
+import BackgroundService from 'react-native-background-actions';
+
+/* ----------------------------- Constants ---------------------------------------- */
+// The service must be declared in AndroidManifest.xml with
+// foregroundServiceType="connectedDevice", plus the FOREGROUND_SERVICE,
+// FOREGROUND_SERVICE_CONNECTED_DEVICE and WAKE_LOCK permissions.
+const SERVICE_OPTIONS = {
+  taskName: 'EspOta',
+  taskTitle: 'Firmware update',
+  taskDesc: 'Starting…',
+  taskIcon: { name: 'ic_launcher', type: 'mipmap' },
+  color: '#007AFF',
+  progressBar: { max: 100, value: 0, indeterminate: true },
+};
+
+let lastNotified = -1; // last percent shown, avoids redundant notification updates
+
+/* ----------------------------- Foreground service ------------------------------- */
+// Runs `job` inside an Android foreground service so the JS thread, its
+// timers and the BLE callbacks keep full speed with the screen off or the
+// app in the background. The job runs in the same JS context, so it can
+// keep writing to the zustand store. Other platforms run `job` directly, and
+// so does Android when the service cannot start (e.g. a foreground service
+// start refused while the app is in the background, or a missing permission).
+export async function runInForegroundService<T>(job: () => Promise<T>): Promise<T> {
+  if (Platform.OS !== 'android') return job();
+  if (BackgroundService.isRunning()) throw new Error('Another background OTA is running');
+
+  lastNotified = -1;
+  let settle!: { resolve: (v: T) => void; reject: (e: unknown) => void };
+  const done = new Promise<T>((resolve, reject) => { settle = { resolve, reject }; });
+  let jobStarted = false;
+
+  try {
+    await BackgroundService.start(async () => {
+      jobStarted = true;
+      try {
+        settle.resolve(await job());
+      } catch (e) {
+        settle.reject(e);
+      }
+    }, SERVICE_OPTIONS);
+  } catch (e) {
+    // a job already running inside the service is awaited and stopped below
+    if (!jobStarted) {
+      console.warn('Foreground service unavailable, running the OTA without it:', e);
+      return job();
+    }
+  }
+
+  try {
+    return await done;
+  } finally {
+    await BackgroundService.stop();
+  }
+}
+
+// Mirrors transfer progress into the service notification; safe to call
+// when no service is running.
+export function updateForegroundProgress(progress: number, kbps: number) {
+  if (Platform.OS !== 'android' || !BackgroundService.isRunning()) return;
+  if (progress === lastNotified) return;
+  lastNotified = progress;
+  BackgroundService.updateNotification({
+    taskDesc: `${progress}%  ·  ${kbps.toFixed(1)} KB/s`,
+    progressBar: { max: 100, value: progress, indeterminate: false },
+  }).catch(() => {});
+}
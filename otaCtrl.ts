@@ -0,0 +1,270 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Buffer } from 'buffer';
+import type { OtaSubscription, OtaTransport } from './otaTransport';
+import { OtaAppDesc, OtaManifest, parseAppDesc } from './otaManifest';
+import { SECTOR_SIZE, withTimeout } from './otaTransfer';
+
+/* ----------------------------- Constants ---------------------------------------- */
+// ota_helper control service (firmware ota_ctrl.c), next to ble_ota's 0x8018.
+// Requests are written to the control char; each is answered by exactly one
+// notification whose first byte is the request opcode | 0x80.
+export const CTRL_OP_DIFF_HASH = 0x01;   // [op][image_len u32][first u16][n u8][n x sha256]
+export const CTRL_OP_DIFF_COMMIT = 0x02; // [op][image_len u32][sector_count u16]
+export const CTRL_OP_DIFF_CLEAR = 0x03;  // [op]
+export const CTRL_OP_WIFI_CAPS = 0x04;   // [op] -> [modes u8]
+export const CTRL_OP_WIFI_START = 0x05;  // [op][mode u8][image_len u32][ssid_len u8][ssid][pass_len u8][pass][url] -> [ipv4]
+export const CTRL_OP_SECTOR_CRC32 = 0x06; // [op]: next session's sectors go to the CRC32 char
+export const CTRL_OP_LINK_INFO = 0x07;   // [op] -> [itvl u16][latency u16][timeout u16][tx_phy u8][rx_phy u8]
+export const CTRL_REPLY = 0x80;
+
+export const CTRL_OK = 0x00;
+const CTRL_REPLY_TIMEOUT_MS = 3000;
+// WIFI_START is answered once the device joined the network and the download began
+const WIFI_START_TIMEOUT_MS = 30000;
+const HASH_LEN = 32;
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+export interface CtrlChannel {
+  request: (req: Buffer, timeoutMs?: number) => Promise<Buffer>;
+  close: () => void;
+}
+
+export type OtaWifiMode = 'sta' | 'softap';
+
+// The device fetches the image from `url` over HTTP: as a station of an
+// existing network, or as a SoftAP the image server joins.
+export interface OtaWifiOptions {
+  mode: OtaWifiMode;
+  ssid: string;
+  password: string;
+  url: string;
+}
+
+// Connection parameters and PHY the central granted, as the device sees them
+export interface OtaLinkGrant {
+  intervalMs: number;
+  latency: number;
+  timeoutMs: number;
+  txPhy: string; // '1M', '2M' or 'coded'
+  rxPhy: string;
+}
+
+export interface SectorDiff {
+  changed: boolean[]; // per image sector, true = must cross BLE
+  changedCount: number;
+}
+
+/* ----------------------------- Control channel ---------------------------------- */
+export function openCtrlChannel(transport: OtaTransport): CtrlChannel {
+  let pending: { op: number; resolve: (v: Buffer) => void; reject: (e: Error) => void } | null = null;
+  let queue = Promise.resolve();
+
+  const sub: OtaSubscription = transport.monitor('ctrl', (err, value) => {
+    if (!pending) return;
+    if (err) {
+      pending.reject(err);
+      pending = null;
+    } else if (value && value[0] === (pending.op | CTRL_REPLY)) {
+      pending.resolve(value);
+      pending = null;
+    }
+  });
+
+  // one request in flight at a time, replies carry no request id
+  const request = (req: Buffer, timeoutMs = CTRL_REPLY_TIMEOUT_MS): Promise<Buffer> => {
+    const run = async () => {
+      const reply = new Promise<Buffer>((resolve, reject) => { pending = { op: req[0], resolve, reject }; });
+      reply.catch(() => {});
+      await transport.write('ctrl', req);
+      try {
+        return await withTimeout(reply, timeoutMs, `ctrl op 0x${req[0].toString(16)} timeout`);
+      } finally {
+        pending = null;
+      }
+    };
+    const result = queue.then(run);
+    queue = result.then(() => {}, () => {});
+    return result;
+  };
+
+  return { request, close: () => sub.remove() };
+}
+
+/* ----------------------------- App description ---------------------------------- */
+// esp_app_desc_t of the firmware the device is running, null without a control service
+export async function readDeviceApp(transport: OtaTransport): Promise<OtaAppDesc | null> {
+  if (!transport.hasCtrl) return null;
+  return parseAppDesc(await transport.read('info'), 0);
+}
+
+/* ----------------------------- Boot profile ------------------------------------- */
+// Milestones of firmware ota_boot.h, in export order
+export const BOOT_MILESTONES = [
+  'bootloader', 'imageLoad', 'appStart', 'appMain', 'nvs', 'appTasks', 'ble', 'firstAction',
+] as const;
+export type OtaBootMilestone = typeof BOOT_MILESTONES[number];
+
+export interface OtaBootProfile {
+  afterUpdate: boolean; // this boot followed an OTA the device accepted
+  resetReason: number;  // esp_reset_reason_t
+  milestonesMs: Partial<Record<OtaBootMilestone, number>>; // since reset, reached milestones only
+}
+
+// Boot profile of the running firmware: [ver][flags][reset reason][n][n x u32 us].
+// Null when the device has no control service or was built without
+// OTA_HELPER_BOOT_PROFILE (the characteristic is then missing).
+export async function readDeviceBoot(transport: OtaTransport): Promise<OtaBootProfile | null> {
+  if (!transport.hasCtrl) return null;
+  let raw: Buffer;
+  try {
+    raw = await transport.read('boot');
+  } catch {
+    return null;
+  }
+  if (raw.length < 4 || raw[0] !== 1) return null;
+  const milestonesMs: OtaBootProfile['milestonesMs'] = {};
+  const n = Math.min(raw[3], BOOT_MILESTONES.length, (raw.length - 4) >> 2);
+  for (let i = 0; i < n; i++) {
+    const us = raw.readUInt32LE(4 + i * 4);
+    if (us !== 0xffffffff) milestonesMs[BOOT_MILESTONES[i]] = us / 1000;
+  }
+  return { afterUpdate: (raw[1] & 0x01) !== 0, resetReason: raw[2], milestonesMs };
+}
+
+/* ----------------------------- Sector diff -------------------------------------- */
+// Sends the manifest's sector hashes; the device compares them with its
+// running partition and arms a plan so unchanged sectors are copied locally.
+// Returns null when the link MTU is too small to carry a hash.
+export async function negotiateSectorDiff(
+  channel: CtrlChannel,
+  manifest: OtaManifest,
+  mtu: number,
+): Promise<SectorDiff | null> {
+  const perWrite = Math.min(255, Math.floor((mtu - 3 - 8) / HASH_LEN));
+  if (perWrite < 1) return null;
+
+  const changed = new Array<boolean>(manifest.sectorCount).fill(true);
+  let changedCount = 0;
+  for (let first = 0; first < manifest.sectorCount; first += perWrite) {
+    const n = Math.min(perWrite, manifest.sectorCount - first);
+    const req = Buffer.alloc(8 + n * HASH_LEN);
+    req.writeUInt8(CTRL_OP_DIFF_HASH, 0);
+    req.writeUInt32LE(manifest.imageBytes, 1);
+    req.writeUInt16LE(first, 5);
+    req.writeUInt8(n, 7);
+    for (let i = 0; i < n; i++) {
+      Buffer.from(manifest.sectorSha256[first + i], 'hex').copy(req, 8 + i * HASH_LEN);
+    }
+    const reply = await channel.request(req);
+    if (reply[1] !== CTRL_OK) throw new Error(`Sector diff rejected at ${first} (status=${reply[1]})`);
+    for (let i = 0; i < n; i++) {
+      changed[first + i] = (reply[5 + (i >> 3)] & (1 << (i & 7))) !== 0;
+      if (changed[first + i]) changedCount++;
+    }
+  }
+
+  const commit = Buffer.alloc(7);
+  commit.writeUInt8(CTRL_OP_DIFF_COMMIT, 0);
+  commit.writeUInt32LE(manifest.imageBytes, 1);
+  commit.writeUInt16LE(manifest.sectorCount, 5);
+  const reply = await channel.request(commit);
+  if (reply[1] !== CTRL_OK || reply.readUInt16LE(2) !== changedCount) {
+    throw new Error(`Sector diff commit failed (status=${reply[1]})`);
+  }
+  return { changed, changedCount };
+}
+
+export async function clearSectorDiff(channel: CtrlChannel): Promise<void> {
+  await channel.request(Buffer.from([CTRL_OP_DIFF_CLEAR]));
+}
+
+// What actually crosses ble_ota under a diff plan: the changed sectors back to
+// back, renumbered from 0, with their CRCs (of the negotiated width) taken from the manifest.
+export function buildDiffPayload(firmware: Buffer, manifest: OtaManifest, diff: SectorDiff, crc32 = false) {
+  const parts: Buffer[] = [];
+  const sectorCrcs: number[] = [];
+  const crcs = crc32 ? manifest.sectorCrc32 : manifest.sectorCrc16;
+  diff.changed.forEach((isChanged, s) => {
+    if (!isChanged) return;
+    parts.push(firmware.subarray(s * SECTOR_SIZE, Math.min((s + 1) * SECTOR_SIZE, firmware.length)));
+    sectorCrcs.push(crcs[s]);
+  });
+  return { payload: Buffer.concat(parts), sectorCrcs };
+}
+
+/* ----------------------------- CRC32 sectors ------------------------------------ */
+// True when the firmware takes this session's sectors with a CRC32 on its own
+// char; older firmware rejects the opcode and the transfer keeps RECV_FW and CRC16.
+export async function enableSectorCrc32(channel: CtrlChannel): Promise<boolean> {
+  try {
+    const reply = await channel.request(Buffer.from([CTRL_OP_SECTOR_CRC32]));
+    return reply[1] === CTRL_OK;
+  } catch {
+    return false;
+  }
+}
+
+/* ----------------------------- Link parameters ---------------------------------- */
+const PHY_NAMES: Record<number, string> = { 1: '1M', 2: '2M', 3: 'coded' };
+
+// The interval and PHY actually in use. Neither OS reports them to the app, and
+// the device asks for faster ones once the transfer starts. Null on firmware
+// without the opcode.
+export async function readLinkGrant(channel: CtrlChannel): Promise<OtaLinkGrant | null> {
+  try {
+    const reply = await channel.request(Buffer.from([CTRL_OP_LINK_INFO]));
+    if (reply[1] !== CTRL_OK || reply.length < 10) return null;
+    return {
+      intervalMs: reply.readUInt16LE(2) * 1.25,
+      latency: reply.readUInt16LE(4),
+      timeoutMs: reply.readUInt16LE(6) * 10,
+      txPhy: PHY_NAMES[reply[8]] ?? String(reply[8]),
+      rxPhy: PHY_NAMES[reply[9]] ?? String(reply[9]),
+    };
+  } catch {
+    return null;
+  }
+}
+
+/* ----------------------------- Wi-Fi transfer ----------------------------------- */
+const WIFI_MODE_BITS: Record<OtaWifiMode, number> = { sta: 0x01, softap: 0x02 };
+
+// Modes the firmware offers; none when it was built without the Wi-Fi path.
+// The firmware refuses the Wi-Fi ops on an unencrypted link, which makes the
+// OS pair and retry here, before startWifiTransfer sends any credentials.
+export async function readWifiModes(channel: CtrlChannel): Promise<OtaWifiMode[]> {
+  try {
+    const reply = await channel.request(Buffer.from([CTRL_OP_WIFI_CAPS]));
+    if (reply[1] !== CTRL_OK) return [];
+    return (Object.keys(WIFI_MODE_BITS) as OtaWifiMode[]).filter(m => (reply[2] & WIFI_MODE_BITS[m]) !== 0);
+  } catch {
+    return [];
+  }
+}
+
+// Hands the device credentials and the image URL. Resolves with the device's
+// IPv4 address once the download runs; progress then arrives on ble_ota's
+// progress characteristic as for a BLE transfer.
+export async function startWifiTransfer(
+  channel: CtrlChannel,
+  wifi: OtaWifiOptions,
+  imageBytes: number,
+): Promise<string> {
+  const ssid = Buffer.from(wifi.ssid, 'utf8');
+  const password = Buffer.from(wifi.password, 'utf8');
+  const url = Buffer.from(wifi.url, 'utf8');
+  if (ssid.length > 32 || password.length > 64 || url.length > 255) {
+    throw new Error('Wi-Fi credentials or URL too long');
+  }
+  const req = Buffer.concat([
+    Buffer.from([CTRL_OP_WIFI_START, WIFI_MODE_BITS[wifi.mode]]),
+    Buffer.alloc(4),
+    Buffer.from([ssid.length]), ssid,
+    Buffer.from([password.length]), password,
+    url,
+  ]);
+  req.writeUInt32LE(imageBytes, 2);
+  const reply = await channel.request(req, WIFI_START_TIMEOUT_MS);
+  if (reply[1] !== CTRL_OK) throw new Error(`Wi-Fi transfer refused (status=${reply[1]})`);
+  return Array.from(reply.subarray(2, 6)).join('.');
+}
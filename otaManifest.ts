@@ -0,0 +1,110 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Buffer } from 'buffer';
+import { sha256 } from '@noble/hashes/sha256';
+import { calcCrc16, calcCrc32, SECTOR_SIZE } from './otaTransfer';
+
+/* ----------------------------- Constants ---------------------------------------- */
+export const OTA_MANIFEST_VERSION = 2;
+
+// esp_app_desc_t sits right after the image header (24 B) and the first
+// segment header (8 B) of an ESP-IDF app image
+const APP_DESC_OFFSET = 32;
+const APP_DESC_MAGIC = 0xabcd5432;
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+export interface OtaAppDesc {
+  version: string;
+  projectName: string;
+  time: string;
+  date: string;
+  idfVersion: string;
+  elfSha256: string; // hex
+}
+
+// Everything derived from an image that does not depend on the target
+// device; built once per image and reused for every transfer of it.
+export interface OtaManifest {
+  version: number;
+  imageBytes: number;
+  sectorSize: number;
+  sectorCount: number;
+  imageSha256: string;    // hex
+  sectorCrc16: number[];  // ble_ota CRC16-CCITT of each sector
+  sectorCrc32: number[];  // CRC32 of each sector, for the ota_helper CRC32 sector char
+  sectorSha256: string[]; // hex, for comparing sectors against the running firmware
+  app: OtaAppDesc | null; // null when the image has no esp_app_desc_t
+}
+
+/* ----------------------------- helper functions --------------------------------- */
+const hex = (bytes: Uint8Array) => Buffer.from(bytes).toString('hex');
+
+const cString = (buf: Buffer, offset: number, length: number) => {
+  const field = buf.subarray(offset, offset + length);
+  const end = field.indexOf(0);
+  return field.subarray(0, end < 0 ? length : end).toString('utf8');
+};
+
+export function imageSha256(firmware: Buffer): string {
+  return hex(sha256(firmware));
+}
+
+// `offset` is 0 for a bare esp_app_desc_t, as read from the device
+export function parseAppDesc(buf: Buffer, offset = APP_DESC_OFFSET): OtaAppDesc | null {
+  if (buf.length < offset + 256) return null;
+  if (buf.readUInt32LE(offset) !== APP_DESC_MAGIC) return null;
+  const d = buf.subarray(offset, offset + 256);
+  return {
+    version: cString(d, 16, 32),
+    projectName: cString(d, 48, 32),
+    time: cString(d, 80, 16),
+    date: cString(d, 96, 16),
+    idfVersion: cString(d, 112, 32),
+    elfSha256: hex(d.subarray(144, 176)),
+  };
+}
+
+// Same build: the ELF hash covers code and data, version strings alone are
+// often left unchanged between development builds.
+export function isSameApp(a: OtaAppDesc, b: OtaAppDesc): boolean {
+  return a.elfSha256 === b.elfSha256 && a.version === b.version && a.projectName === b.projectName;
+}
+
+/* ---------------------------- Manifest -------------------------------------------- */
+// `digest` lets a caller that already hashed the image (to look up a
+// cached manifest) skip the second whole-image pass.
+export function buildOtaManifest(firmware: Buffer, digest?: string): OtaManifest {
+  const sectorCount = Math.ceil(firmware.length / SECTOR_SIZE);
+  const sectorCrc16: number[] = new Array(sectorCount);
+  const sectorCrc32: number[] = new Array(sectorCount);
+  const sectorSha256: string[] = new Array(sectorCount);
+  for (let s = 0; s < sectorCount; s++) {
+    const chunk = firmware.subarray(s * SECTOR_SIZE, Math.min((s + 1) * SECTOR_SIZE, firmware.length));
+    sectorCrc16[s] = calcCrc16(chunk);
+    sectorCrc32[s] = calcCrc32(chunk);
+    sectorSha256[s] = hex(sha256(chunk));
+  }
+  return {
+    version: OTA_MANIFEST_VERSION,
+    imageBytes: firmware.length,
+    sectorSize: SECTOR_SIZE,
+    sectorCount,
+    imageSha256: digest ?? imageSha256(firmware),
+    sectorCrc16,
+    sectorCrc32,
+    sectorSha256,
+    app: parseAppDesc(firmware),
+  };
+}
+
+// A cached manifest is only trusted when it was built for this exact image
+// with the current layout.
+export function manifestMatches(manifest: OtaManifest, firmware: Buffer, digest: string): boolean {
+  return (
+    manifest.version === OTA_MANIFEST_VERSION &&
+    manifest.sectorSize === SECTOR_SIZE &&
+    manifest.imageBytes === firmware.length &&
+    manifest.imageSha256 === digest &&
+    manifest.sectorCrc16.length === manifest.sectorCount &&
+    manifest.sectorCrc32.length === manifest.sectorCount
+  );
+}
@@ -0,0 +1,407 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Buffer } from 'buffer';
+import { sha256 } from '@noble/hashes/sha256';
+import { OtaChar, OtaCharListener, OtaSubscription, OtaTransport } from './otaTransport';
+import {
+  calcCrc16,
+  calcCrc32,
+  delay,
+  SECTOR_ACK_BUSY,
+  SECTOR_ACK_CRC_ERROR,
+  SECTOR_ACK_INDEX_ERROR,
+  SECTOR_ACK_OK,
+  SECTOR_SIZE,
+} from './otaTransfer';
+import {
+  CTRL_OK,
+  CTRL_OP_DIFF_CLEAR,
+  CTRL_OP_DIFF_COMMIT,
+  CTRL_OP_DIFF_HASH,
+  CTRL_OP_LINK_INFO,
+  CTRL_OP_SECTOR_CRC32,
+  CTRL_OP_WIFI_CAPS,
+  CTRL_REPLY,
+} from './otaCtrl';
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+// CONFIG_OTA_HELPER_SINK_*: where ota_task puts received sectors
+export type OtaSimulatorSink = 'full' | 'scratch' | 'discard';
+
+export interface OtaSimulatorOptions {
+  id?: string;
+  name?: string;
+  mtu?: number;                 // negotiated ATT MTU, writes above MTU - 3 are rejected
+  writeLatencyMs?: number;      // ATT write-with-response round trip (≈ connection interval)
+  notifyLatencyMs?: number;     // device -> phone notification delay
+  flashWriteLatencyMs?: number; // ota_task esp_ota_write of one 4KB sector
+  packetLoss?: number;          // probability a RECV_FW packet never reaches ble_ota (0..1)
+  ringbufSectors?: number;      // ota_helper ring buffer depth (8KB = 2 sectors)
+  queueWaitMs?: number;         // RECV_FW callback wait for queue room before the device ends the session (20 ms)
+  seed?: number;                // packet loss PRNG seed, for repeatable runs
+  runningImage?: Buffer;        // firmware in the running partition, source of sector diffs
+  sink?: OtaSimulatorSink;      // 'discard' drops sectors after the queue, no flash time
+  sectorCrc32?: boolean;        // firmware has the CRC32 sector char (CONFIG_OTA_HELPER_SECTOR_CRC32)
+}
+
+export interface OtaSimulatorStats {
+  packets: number;
+  lostPackets: number;
+  crcErrors: number;
+  indexErrors: number;
+  droppedSectors: number; // ring buffer still full after the wait, same as write_to_ringbuf() failing on the device
+  flashedBytes: number;
+  copiedSectors: number;  // unchanged sectors copied from the running partition
+}
+
+/* ----------------------------- helper functions --------------------------------- */
+// mulberry32
+function createRng(seed: number) {
+  let a = seed >>> 0;
+  return () => {
+    a = (a + 0x6d2b79f5) >>> 0;
+    let t = a;
+    t = Math.imul(t ^ (t >>> 15), t | 1);
+    t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+function makeAck(b0: number, b1: number, b2: number): Buffer {
+  const ack = Buffer.alloc(20, 0x00);
+  ack.writeUInt16LE(b0, 0);
+  ack.writeUInt16LE(b1, 2);
+  ack.writeUInt16LE(b2, 4);
+  ack.writeUInt16LE(calcCrc16(ack.subarray(0, 18)), 18);
+  return ack;
+}
+
+/* ---------------------------- Simulated ESP32 ------------------------------------- */
+// In-process stand-in for the ESP32 side: ble_ota sector reassembly and CRC
+// check, the ota_helper ring buffer and ota_task flash writer, and the
+// progress notifications. Behaves like createBlePlxTransport() to otaTransfer.
+export class SimulatedOtaDevice implements OtaTransport {
+  readonly id: string;
+  readonly name: string;
+  readonly simulated = true;
+  readonly mtu: number;
+  readonly hasCtrl = true;
+
+  private opts: Required<Omit<OtaSimulatorOptions, 'id' | 'name' | 'seed' | 'runningImage'>>;
+  private running: Buffer;
+  private rng: () => number;
+  private listeners = new Map<OtaChar, Set<OtaCharListener>>();
+  private disconnectListeners = new Set<(err: Error | null) => void>();
+  private connected = true;
+
+  // ble_ota state
+  private fwLength = 0;
+  private curSector = 0;
+  private curPacket = 0;
+  private sectorBuf = Buffer.alloc(SECTOR_SIZE);
+  private sectorOff = 0;
+  private sectorCorrupt = false;
+
+  // ota_helper state
+  private flash: Buffer = Buffer.alloc(0);
+  private queue: Buffer[] = [];
+  private flashBusy = false;
+  private aborted = false; // ota_core_abort(): ota_task ends the session at its next item
+  private recvLen = 0;
+  private imageLen = 0;
+  private written = 0;
+  private recvSector = 0; // image sector the next received one lands in
+  private copied = false; // unchanged sectors of the plan done
+  private plan = { active: false, imageLen: 0, changed: [] as boolean[] };
+
+  readonly stats: OtaSimulatorStats = {
+    packets: 0,
+    lostPackets: 0,
+    crcErrors: 0,
+    indexErrors: 0,
+    droppedSectors: 0,
+    flashedBytes: 0,
+    copiedSectors: 0,
+  };
+
+  constructor(options: OtaSimulatorOptions = {}) {
+    this.id = options.id ?? 'simulator';
+    this.name = options.name ?? 'OTA Simulator';
+    this.opts = {
+      mtu: options.mtu ?? 517,
+      writeLatencyMs: options.writeLatencyMs ?? 15,
+      notifyLatencyMs: options.notifyLatencyMs ?? options.writeLatencyMs ?? 15,
+      flashWriteLatencyMs: options.flashWriteLatencyMs ?? 25,
+      packetLoss: options.packetLoss ?? 0,
+      ringbufSectors: options.ringbufSectors ?? 2,
+      queueWaitMs: options.queueWaitMs ?? 20,
+      sink: options.sink ?? 'full',
+      sectorCrc32: options.sectorCrc32 ?? true,
+    };
+    this.mtu = this.opts.mtu;
+    this.rng = createRng(options.seed ?? 1);
+    this.running = options.runningImage ?? Buffer.alloc(0);
+  }
+
+  /* ------------------------------ OtaTransport ------------------------------------ */
+  write = async (char: OtaChar, data: Buffer): Promise<void> => {
+    if (!this.connected) throw new Error('Simulated device is disconnected');
+    if (data.length > this.opts.mtu - 3) {
+      throw new Error(`Write of ${data.length} bytes exceeds MTU ${this.opts.mtu}`);
+    }
+    await delay(this.opts.writeLatencyMs);
+    if (char === 'command') this.onCommand(data);
+    else if (char === 'recvFw') await this.onRecvFw(data, false);
+    else if (char === 'recvFw32' && this.opts.sectorCrc32) await this.onRecvFw(data, true);
+    else if (char === 'ctrl') this.onCtrl(data);
+    else throw new Error(`Characteristic ${char} is not writable`);
+  };
+
+  read = async (char: OtaChar): Promise<Buffer> => {
+    if (!this.connected) throw new Error('Simulated device is disconnected');
+    await delay(this.opts.writeLatencyMs);
+    // esp_app_get_description() of the running image
+    if (char === 'info') return Buffer.from(this.running.subarray(32, 32 + 256));
+    throw new Error(`Characteristic ${char} is not readable`);
+  };
+
+  monitor = (char: OtaChar, listener: OtaCharListener): OtaSubscription => {
+    if (!this.listeners.has(char)) this.listeners.set(char, new Set());
+    this.listeners.get(char)!.add(listener);
+    return { remove: () => { this.listeners.get(char)?.delete(listener); } };
+  };
+
+  onDisconnected = (listener: (err: Error | null) => void): OtaSubscription => {
+    this.disconnectListeners.add(listener);
+    return { remove: () => { this.disconnectListeners.delete(listener); } };
+  };
+
+  isConnected = async (): Promise<boolean> => this.connected;
+
+  disconnect = async (): Promise<void> => {
+    this.connected = false;
+    this.disconnectListeners.forEach(l => l(null));
+  };
+
+  /* ------------------------------ Inspection -------------------------------------- */
+  // true when the simulated ota_1 partition holds exactly `image`; never with the discard sink
+  verify(image: Buffer): boolean {
+    if (this.opts.sink === 'discard') return false;
+    return this.written === image.length && this.flash.subarray(0, this.written).equals(image);
+  }
+
+  /* ------------------------------ ble_ota ----------------------------------------- */
+  private notify(char: OtaChar, value: Buffer) {
+    setTimeout(() => this.listeners.get(char)?.forEach(l => l(null, value)), this.opts.notifyLatencyMs);
+  }
+
+  private onCommand(data: Buffer) {
+    if (data.length < 20 || calcCrc16(data.subarray(0, 18)) !== data.readUInt16LE(18)) return;
+    const cmd = data.readUInt16LE(0);
+    if (cmd === 0x0001) {
+      this.fwLength = data.readUInt32LE(2);
+      this.curSector = 0;
+      this.curPacket = 0;
+      this.sectorOff = 0;
+      this.sectorCorrupt = false;
+      this.imageLen = this.plan.active ? this.plan.imageLen : this.fwLength;
+      this.flash = Buffer.alloc(this.imageLen);
+      this.queue = [];
+      this.aborted = false;
+      this.recvLen = 0;
+      this.written = 0;
+      this.recvSector = 0;
+      this.copied = false;
+    }
+    // command ack: 0x0003, echoed command id, status 0 (accepted)
+    this.notify('command', makeAck(0x0003, cmd, 0x0000));
+  }
+
+  // RECV_FW with CRC16, or ota_helper's CRC32 char: same framing, wider
+  // trailer, acks on the char written to and BUSY instead of waiting for room
+  private async onRecvFw(data: Buffer, crc32: boolean) {
+    const ackChar: OtaChar = crc32 ? 'recvFw32' : 'recvFw';
+    const trailer = crc32 ? 4 : 2;
+    this.stats.packets++;
+    if (this.rng() < this.opts.packetLoss) {
+      this.stats.lostPackets++;
+      return;
+    }
+    const sector = data.readUInt16LE(0);
+    const seq = data.readUInt8(2);
+    const isLast = seq === 0xff;
+
+    if (sector !== this.curSector) {
+      if (isLast) {
+        this.stats.indexErrors++;
+        this.notify(ackChar, makeAck(sector, SECTOR_ACK_INDEX_ERROR, this.curSector));
+      }
+      return;
+    }
+
+    // first packet of a resent sector resynchronizes reassembly
+    if (seq === 0) {
+      this.sectorOff = 0;
+      this.curPacket = 0;
+      this.sectorCorrupt = false;
+    }
+    if (!isLast && seq !== this.curPacket) this.sectorCorrupt = true;
+    this.curPacket = isLast ? 0 : seq + 1;
+
+    const payload = data.subarray(3, data.length - (isLast ? trailer : 0));
+    if (this.sectorOff + payload.length > SECTOR_SIZE) {
+      this.sectorCorrupt = true;
+    } else {
+      payload.copy(this.sectorBuf, this.sectorOff);
+      this.sectorOff += payload.length;
+    }
+    if (!isLast) return;
+
+    const sectorData = Buffer.from(this.sectorBuf.subarray(0, this.sectorOff));
+    const crcOk = !this.sectorCorrupt && (crc32
+      ? calcCrc32(sectorData) === data.readUInt32LE(data.length - 4)
+      : calcCrc16(sectorData) === data.readUInt16LE(data.length - 2));
+    this.sectorOff = 0;
+    this.sectorCorrupt = false;
+    if (!crcOk) {
+      this.stats.crcErrors++;
+      this.notify(ackChar, makeAck(sector, SECTOR_ACK_CRC_ERROR, this.curSector));
+      return;
+    }
+
+    if (crc32) {
+      if (!this.writeToRingbuf(sectorData)) {
+        this.notify(ackChar, makeAck(sector, SECTOR_ACK_BUSY, this.curSector));
+        return;
+      }
+      this.curSector++;
+      this.notify(ackChar, makeAck(sector, SECTOR_ACK_OK, this.curSector));
+      return;
+    }
+    // ota_recv_fw_cb() waits briefly for room; ble_ota acks the sector either
+    // way and one that still does not fit ends the session through ota_task
+    const queued = await this.waitForRoom();
+    this.curSector++;
+    this.notify(ackChar, makeAck(sector, SECTOR_ACK_OK, this.curSector));
+    if (!queued) {
+      this.stats.droppedSectors++;
+      this.aborted = true;
+      return;
+    }
+    this.writeToRingbuf(sectorData);
+  }
+
+  /* ------------------------------ ota_helper -------------------------------------- */
+  private onCtrl(data: Buffer) {
+    const op = data[0];
+    const reply = (status: number, body: number[] = []) =>
+      this.notify('ctrl', Buffer.from([op | CTRL_REPLY, status, ...body]));
+
+    if (op === CTRL_OP_DIFF_HASH) {
+      const imageLen = data.readUInt32LE(1);
+      const first = data.readUInt16LE(5);
+      const n = data[7];
+      if (first === 0) this.plan = { active: false, imageLen, changed: [] };
+      if (first !== this.plan.changed.length || imageLen !== this.plan.imageLen) {
+        return reply(0x02, [data[5], data[6], n]);
+      }
+      const mask = new Array<number>((n + 7) >> 3).fill(0);
+      for (let i = 0; i < n; i++) {
+        const off = (first + i) * SECTOR_SIZE;
+        const len = Math.min(SECTOR_SIZE, imageLen - off);
+        const ours = Buffer.from(sha256(this.running.subarray(off, off + len)));
+        const differs = this.running.length < off + len ||
+          !ours.equals(data.subarray(8 + i * 32, 8 + (i + 1) * 32));
+        this.plan.changed.push(differs);
+        if (differs) mask[i >> 3] |= 1 << (i & 7);
+      }
+      reply(CTRL_OK, [data[5], data[6], n, ...mask]);
+    } else if (op === CTRL_OP_DIFF_COMMIT) {
+      const ok = data.readUInt32LE(1) === this.plan.imageLen && data.readUInt16LE(5) === this.plan.changed.length;
+      if (ok) this.plan.active = true;
+      const changed = this.plan.changed.filter(Boolean).length;
+      reply(ok ? CTRL_OK : 0x02, [changed & 0xff, changed >> 8]);
+    } else if (op === CTRL_OP_DIFF_CLEAR) {
+      this.plan = { active: false, imageLen: 0, changed: [] };
+      reply(CTRL_OK);
+    } else if (op === CTRL_OP_WIFI_CAPS) {
+      // no radio to simulate: the app keeps the BLE path
+      reply(CTRL_OK, [0]);
+    } else if (op === CTRL_OP_SECTOR_CRC32 && this.opts.sectorCrc32) {
+      reply(CTRL_OK);
+    } else if (op === CTRL_OP_LINK_INFO) {
+      // the write round trip stands in for the connection interval, 2M both ways
+      const itvl = Math.max(6, Math.round(this.opts.writeLatencyMs / 1.25));
+      reply(CTRL_OK, [itvl & 0xff, itvl >> 8, 0, 0, 400 & 0xff, 400 >> 8, 2, 2]);
+    } else {
+      // the write fails like an unknown op on the device (ATT "request not supported")
+      throw new Error(`ctrl op 0x${op.toString(16)} not supported`);
+    }
+  }
+
+  // ota_task under a diff plan: every sector equal to the running image is
+  // copied locally before the first received one is written
+  private async copyUnchangedSectors() {
+    if (!this.plan.active || this.copied) return;
+    this.copied = true;
+    for (let off = 0; off < this.imageLen; off += SECTOR_SIZE) {
+      if (this.plan.changed[off / SECTOR_SIZE] !== false) continue;
+      const len = Math.min(SECTOR_SIZE, this.imageLen - off);
+      if (this.opts.sink !== 'discard') {
+        await delay(this.opts.flashWriteLatencyMs);
+        this.running.copy(this.flash, off, off, off + len);
+      }
+      this.written += len;
+      this.stats.copiedSectors++;
+    }
+  }
+
+  private async waitForRoom(): Promise<boolean> {
+    const until = Date.now() + this.opts.queueWaitMs;
+    while (this.queue.length >= this.opts.ringbufSectors) {
+      if (this.aborted || Date.now() >= until) return false;
+      await delay(1);
+    }
+    return true;
+  }
+
+  // false when xRingbufferSend(..., 0) failed, the CRC32 path then acks BUSY
+  private writeToRingbuf(sectorData: Buffer): boolean {
+    if (this.aborted) return false;
+    if (this.queue.length >= this.opts.ringbufSectors) {
+      this.stats.droppedSectors++;
+      return false;
+    }
+    this.queue.push(sectorData);
+    if (!this.flashBusy) this.runOtaTask();
+    return true;
+  }
+
+  private async runOtaTask() {
+    this.flashBusy = true;
+    while (this.queue.length) {
+      if (this.aborted) {
+        // finished(err): glue_finished() waits 2 s, then reboots
+        this.queue = [];
+        await delay(2000);
+        this.connected = false;
+        this.disconnectListeners.forEach(l => l(new Error('Simulated device rebooted: sector queue full')));
+        break;
+      }
+      const item = this.queue[0];
+      await this.copyUnchangedSectors();
+      const discard = this.opts.sink === 'discard';
+      // a zero delay still yields, like ota_task blocking on the queue
+      await delay(discard ? 0 : this.opts.flashWriteLatencyMs);
+      this.queue.shift();
+      while (this.plan.active && this.plan.changed[this.recvSector] === false) this.recvSector++;
+      if (!discard) item.copy(this.flash, this.recvSector * SECTOR_SIZE);
+      this.recvSector++;
+      this.written += item.length;
+      this.recvLen += item.length;
+      if (!discard) this.stats.flashedBytes += item.length;
+      const progress = Math.floor((this.recvLen * 100) / this.fwLength);
+      this.notify('progress', Buffer.from([progress]));
+    }
+    this.flashBusy = false;
+  }
+}
@@ -0,0 +1,92 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import type { OtaLinkGrant } from './otaCtrl';
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+export interface OtaLinkParams {
+  mtu: number;
+  chunkSize: number;
+  window: number;
+  priority: string | null; // connection priority the app requested, null if not requested
+  granted?: OtaLinkGrant | null; // interval and PHY the device reports once the transfer runs
+}
+
+export interface OtaStats {
+  link: OtaLinkParams;
+  progress: number;        // device-reported percent
+  totalBytes: number;
+  sentBytes: number;       // put on the air, including resent sectors
+  confirmedBytes: number;  // acknowledged by device progress
+  bytesInFlight: number;
+  instKBps: number;        // confirmed throughput over the last RATE_WINDOW_MS
+  avgKBps: number;         // confirmed throughput since the start command
+  etaSec: number | null;
+  retransmits: number;
+  elapsedMs: number;
+}
+
+/* ----------------------------- Constants ---------------------------------------- */
+const PUBLISH_INTERVAL_MS = 250; // at most 4 UI updates per second
+const RATE_WINDOW_MS = 2000;
+
+/* ----------------------------- Tracker ------------------------------------------ */
+// Transfer bookkeeping lives in plain closures and is updated per sector;
+// only a snapshot is handed to `publish`, on a fixed interval.
+export function createOtaStatsTracker(
+  totalBytes: number,
+  link: OtaLinkParams,
+  publish: (stats: OtaStats) => void,
+  intervalMs = PUBLISH_INTERVAL_MS,
+) {
+  const startedAt = Date.now();
+  let sentBytes = 0;
+  let confirmedBytes = 0;
+  let discardedBytes = 0; // sent, then given up on by a go-back and sent again
+  let retransmits = 0;
+  let progress = 0;
+  let samples: { t: number; bytes: number }[] = [{ t: startedAt, bytes: 0 }];
+
+  const snapshot = (): OtaStats => {
+    const now = Date.now();
+    const elapsedMs = now - startedAt;
+    samples = samples.filter(s => now - s.t <= RATE_WINDOW_MS);
+    const oldest = samples[0] ?? { t: now, bytes: confirmedBytes };
+    const instKBps = now > oldest.t
+      ? (confirmedBytes - oldest.bytes) / 1024 / ((now - oldest.t) / 1000)
+      : 0;
+    const avgKBps = elapsedMs > 0 ? confirmedBytes / 1024 / (elapsedMs / 1000) : 0;
+    const rate = instKBps > 0 ? instKBps : avgKBps;
+    return {
+      link,
+      progress,
+      totalBytes,
+      sentBytes,
+      confirmedBytes,
+      bytesInFlight: Math.max(0, sentBytes - confirmedBytes - discardedBytes),
+      instKBps,
+      avgKBps,
+      etaSec: rate > 0 ? (totalBytes - confirmedBytes) / 1024 / rate : null,
+      retransmits,
+      elapsedMs,
+    };
+  };
+
+  const timer = setInterval(() => publish(snapshot()), intervalMs);
+
+  return {
+    onProgress: (pct: number) => { progress = pct; },
+    onLinkGrant: (grant: OtaLinkGrant) => { link = { ...link, granted: grant }; },
+    onSectorSent: (bytes: number) => { sentBytes += bytes; },
+    onSectorConfirmed: (bytes: number) => {
+      confirmedBytes += bytes;
+      samples.push({ t: Date.now(), bytes: confirmedBytes });
+    },
+    onRewind: (bytes: number, count: number) => {
+      discardedBytes += bytes;
+      retransmits = count;
+    },
+    stop: () => {
+      clearInterval(timer);
+      publish(snapshot());
+    },
+  };
+}
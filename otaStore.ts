@@ -1,98 +1,319 @@
 /* ----------------------------- Imports ----------------------------------------- */
 import { Buffer } from 'buffer';
-import { Device, Subscription } from 'react-native-ble-plx';
+import { Device } from 'react-native-ble-plx';
 import { create } from 'zustand';
 import { subscribeWithSelector } from 'zustand/middleware';
-import { BLE_MANAGER } from '../constants';
+import {
+  BLE_MANAGER,
+  ESP32_ADVERTISE_UUID,
+  ESP32_SERVICE_UUID,
+  RENESAS_SERVICE_UUID,
+  SIMULATION_TARGET_UUIDs,
+} from '../constants';
 import { DeviceProfile, DeviceType, getDeviceProfile } from './deviceStore';
-import { PermissionsAndroid, Platform } from 'react-native';
+import { PermissionsAndroid, Platform, Share } from 'react-native';
 import RNFS from 'react-native-fs';
+import {
+  createBlePlxTransport,
+  OTA_CTRL_SERVICE_UUID,
+  OtaConnectionPriority,
+  OtaSubscription,
+  OtaTransport,
+} from './otaTransport';
+import { runOtaTransfer } from './otaTransfer';
+import { SimulatedOtaDevice } from './otaSimulator';
+import { createOtaStatsTracker, OtaStats } from './otaStats';
+import { OtaTraceRecorder } from './otaTrace';
+import { runInForegroundService, updateForegroundProgress } from './otaBackground';
+import {
+  buildOtaManifest,
+  imageSha256,
+  isSameApp,
+  manifestMatches,
+  OtaAppDesc,
+  OtaManifest,
+} from './otaManifest';
+import {
+  buildDiffPayload,
+  clearSectorDiff,
+  enableSectorCrc32,
+  negotiateSectorDiff,
+  openCtrlChannel,
+  OtaBootProfile,
+  OtaWifiOptions,
+  readDeviceApp,
+  readDeviceBoot,
+  readLinkGrant,
+  readWifiModes,
+  startWifiTransfer,
+} from './otaCtrl';
 
 /* ----------------------------- Constants ---------------------------------------- */
-const SECTOR_SIZE = 4096; // 4KB
+const OTA_TRACE_DIR = `${RNFS.DocumentDirectoryPath}/ota-traces`;
+const OTA_MANIFEST_DIR = `${RNFS.DocumentDirectoryPath}/ota-manifests`;
+const SCAN_FLUSH_INTERVAL_MS = 250; // scan results reach the store at most this often
+const SCAN_STALE_MS = 10000;        // drop devices not heard from for this long
+const WIFI_PROGRESS_TIMEOUT_MS = 20000; // no progress notification for this long fails a Wi-Fi OTA
 
 /* ----------------------------- helper functions --------------------------------- */
-function calcCrc16(buffer: Buffer): number {
-  let crc = 0;
-  for (let i = 0; i < buffer.length; i++) {
-    crc ^= buffer[i] << 8;
-    for (let j = 0; j < 8; j++) {
-      if (crc & 0x8000) crc = ((crc << 1) ^ 0x1021) & 0xffff;
-      else crc = (crc << 1) & 0xffff;
+// Scan list entries for SIMULATION_TARGET_UUIDs; connectDevice() maps them to
+// a SimulatedOtaDevice instead of a BLE connection.
+const simulatedScanEntries = (): ScanResult[] =>
+  SIMULATION_TARGET_UUIDs.map(id => ({
+    device: { id, name: 'OTA Simulator', localName: 'OTA Simulator' } as unknown as Device,
+    rssi: null,
+    lastSeen: Date.now(),
+  }));
+
+// Advertisements land here (O(1) per advert); flushScanResults() publishes
+// a fresh list to the store on a fixed interval, only when something changed.
+const scanResults = new Map<string, ScanResult>();
+let scanDirty = false;
+let scanFlushTimer: ReturnType<typeof setInterval> | null = null;
+
+function flushScanResults(publish: (results: ScanResult[]) => void) {
+  const now = Date.now();
+  scanResults.forEach((r, id) => {
+    if (r.rssi !== null && now - r.lastSeen > SCAN_STALE_MS) {
+      scanResults.delete(id);
+      scanDirty = true;
     }
+  });
+  if (!scanDirty) return;
+  scanDirty = false;
+  publish(Array.from(scanResults.values()));
+}
+
+// connect timing of the current link, copied into the next session trace
+let lastConnect: { connectMs: number; mtu: number } | null = null;
+
+// OTA service layout per device id, recorded after a full discovery. Used to
+// fail fast when the OTA characteristics are missing and to notice a layout
+// change after a firmware update.
+const gattCache = new Map<string, string[]>();
+// device ids whose current link has already been discovered; cleared on disconnect
+const discoveredLinks = new Set<string>();
+
+async function ensureDiscovered(device: Device): Promise<void> {
+  if (discoveredLinks.has(device.id)) return;
+  await device.discoverAllServicesAndCharacteristics();
+  discoveredLinks.add(device.id);
+  const sub = device.onDisconnected(() => {
+    discoveredLinks.delete(device.id);
+    sub.remove();
+  });
+}
+
+async function checkGattLayout(device: Device, profile: DeviceProfile): Promise<void> {
+  const chars = (await device.characteristicsForService(profile.serviceUUID))
+    .map(c => c.uuid.toLowerCase())
+    .sort();
+  const required = [profile.writeUUID, profile.notifyUUID, profile.commandUUID, profile.customerUUID]
+    .filter((u): u is string => !!u)
+    .map(u => u.toLowerCase());
+  const missing = required.filter(u => !chars.includes(u));
+  if (missing.length) {
+    gattCache.delete(device.id);
+    throw new Error(`OTA characteristics missing on ${device.id}: ${missing.join(', ')}`);
+  }
+  const cached = gattCache.get(device.id);
+  if (cached && cached.join() !== chars.join()) {
+    console.log('🔄 GATT layout changed (firmware update?), cache refreshed:', device.id);
   }
-  return crc;
+  gattCache.set(device.id, chars);
 }
 
-function makeOtaStartCmd(fwLength: number): Buffer {
-  const packet = Buffer.alloc(20, 0x00);
-  packet.writeUInt16LE(0x0001, 0);              // Command ID
-  packet.writeUInt32LE(fwLength, 2);            // Firmware length
-  const crc = calcCrc16(packet.subarray(0, 18));
-  packet.writeUInt16LE(crc, 18);                // CRC16
-  return packet;
+// Only Android lets the central pick the connection interval from the app;
+// resolves to the requested priority, or null when not applicable or refused.
+// The OS does not say what it got; recordLinkGrant asks the device instead.
+async function setLinkPriority(
+  transport: OtaTransport,
+  priority: OtaConnectionPriority,
+): Promise<OtaConnectionPriority | null> {
+  if (Platform.OS !== 'android' || !transport.requestConnectionPriority) return null;
+  try {
+    await transport.requestConnectionPriority(priority);
+    return priority;
+  } catch (e) {
+    console.warn('Connection priority request failed:', e);
+    return null;
+  }
 }
 
-async function sendStartOtaCommand(
-    device: Device, 
-    profile: DeviceProfile, 
-    fwLength: number
+// The device asks for a fast link as the transfer starts; a few sectors in,
+// that request has settled and the interval and PHY it reads back are the real ones.
+const LINK_GRANT_SECTOR = 3;
+
+async function recordLinkGrant(
+  transport: OtaTransport,
+  tracker: ReturnType<typeof createOtaStatsTracker>,
+  trace: OtaTraceRecorder,
 ): Promise<void> {
-    const cmd = makeOtaStartCmd(fwLength);
-    await device.writeCharacteristicWithResponseForService(
-      profile.serviceUUID,
-      profile.commandUUID!,
-      cmd.toString('base64')
-    );
-    console.log('🔄 OTA Start CMD sent (fw_length=', fwLength, ')');
+  const channel = openCtrlChannel(transport);
+  try {
+    const grant = await readLinkGrant(channel);
+    if (!grant) return;
+    console.log(`🔗 Link: ${grant.intervalMs} ms interval, latency ${grant.latency}, ${grant.txPhy}/${grant.rxPhy} PHY`);
+    tracker.onLinkGrant(grant);
+    trace.meta.connIntervalMs = grant.intervalMs;
+    trace.meta.connPhy = `${grant.txPhy}/${grant.rxPhy}`;
+    trace.record('link_grant', -1, grant.intervalMs);
+  } finally {
+    channel.close();
+  }
 }
 
-function withTimeout<T>(promise: Promise<T>, ms: number, errorMsg = 'Operation timed out'): Promise<T> {
-  return new Promise((resolve, reject) => {
-    const timer = setTimeout(() => reject(new Error(errorMsg)), ms);
-    promise
-      .then(res => resolve(res))
-      .catch(err => reject(err))
-      .finally(() => clearTimeout(timer));
-  });
-}
+// Manifests are cached in memory for back-to-back (fleet) sessions and on
+// disk keyed by image digest, so each image is only checksummed per sector once.
+let manifestCache: { base64: string; manifest: OtaManifest } | null = null;
 
-function createProgressHandler(onProgress?: (pct: number) => void) {
-  let current = 0;
-  let waiters: { pct: number; resolve: () => void; reject: (e?: any) => void }[] = [];
-
-  const updateProgress = (newPct: number) => {
-    if (newPct > current) {
-      console.log(`🔄 OTA 진행률: ${current}% -> ${newPct}%`);
-      current = newPct;
-      onProgress?.(current);
-      waiters = waiters.filter(w => {
-        if (current >= w.pct) { w.resolve(); return false; }
-        return true;
-      });
+async function loadManifest(base64Firmware: string, firmware: Buffer): Promise<OtaManifest> {
+  if (manifestCache?.base64 === base64Firmware) return manifestCache.manifest;
+
+  const digest = imageSha256(firmware);
+  const path = `${OTA_MANIFEST_DIR}/${digest}.json`;
+  let manifest: OtaManifest | null = null;
+  try {
+    if (await RNFS.exists(path)) {
+      const cached: OtaManifest = JSON.parse(await RNFS.readFile(path, 'utf8'));
+      if (manifestMatches(cached, firmware, digest)) manifest = cached;
     }
-  };
+  } catch (e) {
+    console.warn('Ignoring unreadable OTA manifest:', path, e);
+  }
+  if (!manifest) {
+    const built = buildOtaManifest(firmware, digest);
+    manifest = built;
+    RNFS.mkdir(OTA_MANIFEST_DIR)
+      .then(() => RNFS.writeFile(path, JSON.stringify(built), 'utf8'))
+      .catch(e => console.warn('Saving OTA manifest failed:', e));
+  }
+  manifestCache = { base64: base64Firmware, manifest };
+  return manifest;
+}
 
-  const waitForProgress = (pct: number) =>
-    new Promise<void>((res, rej) => {
-      if (current >= pct) return res();
-      waiters.push({ pct, resolve: res, reject: rej });
-    });
+// Agrees with the device on the sector checksum and on which sectors differ
+// from its running firmware, and returns what has to cross BLE. Falls back to
+// CRC16 and the full image when the device has no control service or a
+// handshake fails.
+async function planTransfer(
+  transport: OtaTransport,
+  firmware: Buffer,
+  manifest: OtaManifest,
+  trace: OtaTraceRecorder,
+): Promise<{ payload: Buffer; sectorCrcs: number[]; crc32: boolean; copiedSectors?: number }> {
+  if (!transport.hasCtrl) {
+    trace.meta.sectorCrc = 'crc16';
+    return { payload: firmware, sectorCrcs: manifest.sectorCrc16, crc32: false };
+  }
 
-  const rejectAll = (reason: any) => { waiters.forEach(w => w.reject(reason)); waiters = []; };
+  const channel = openCtrlChannel(transport);
+  const crc32 = await enableSectorCrc32(channel);
+  trace.meta.sectorCrc = crc32 ? 'crc32' : 'crc16';
+  const full = { payload: firmware, sectorCrcs: crc32 ? manifest.sectorCrc32 : manifest.sectorCrc16, crc32 };
+  try {
+    trace.record('diff_start', -1, manifest.sectorCount);
+    const diff = await negotiateSectorDiff(channel, manifest, transport.mtu);
+    if (!diff) return full;
+    trace.record('diff_done', -1, diff.changedCount);
+    trace.meta.diffSectors = diff.changedCount;
+    console.log(`🧩 Sector diff: ${diff.changedCount}/${manifest.sectorCount} sectors changed`);
+    if (diff.changedCount === 0) await clearSectorDiff(channel);
+    const copiedSectors = diff.changedCount ? manifest.sectorCount - diff.changedCount : 0;
+    return { ...buildDiffPayload(firmware, manifest, diff, crc32), crc32, copiedSectors };
+  } catch (e) {
+    console.warn('Sector diff failed, sending the full image:', e);
+    trace.error(e);
+    await clearSectorDiff(channel).catch(() => {});
+    return full;
+  } finally {
+    channel.close();
+  }
+}
 
-  return { updateProgress, waitForProgress, rejectAll };
+// Wi-Fi path: the device downloads the image itself and reports progress over
+// BLE. Returns false, before anything is sent, when the firmware has no Wi-Fi
+// path for this mode so the caller can fall back to BLE.
+async function runWifiTransfer(
+  transport: OtaTransport,
+  imageBytes: number,
+  wifi: OtaWifiOptions,
+  onProgress: (pct: number) => void,
+  trace: OtaTraceRecorder,
+): Promise<boolean> {
+  if (!transport.hasCtrl) return false;
+  const channel = openCtrlChannel(transport);
+  const subs: OtaSubscription[] = [];
+  let timer: ReturnType<typeof setTimeout> | null = null;
+  try {
+    if (!(await readWifiModes(channel)).includes(wifi.mode)) return false;
+
+    const done = new Promise<void>((resolve, reject) => {
+      const arm = () => {
+        if (timer) clearTimeout(timer);
+        timer = setTimeout(() => reject(new Error('Wi-Fi OTA progress timeout')), WIFI_PROGRESS_TIMEOUT_MS);
+      };
+      subs.push(transport.monitor('progress', (err, value) => {
+        if (err) return reject(err);
+        if (!value) return;
+        const pct = value.readUInt8(0);
+        onProgress(pct);
+        if (pct >= 100) resolve();
+        else arm();
+      }));
+      subs.push(transport.onDisconnected(() => reject(new Error('Device disconnected during Wi-Fi OTA'))));
+      arm();
+    });
+    done.catch(() => {});
+
+    trace.meta.transport = 'wifi';
+    trace.record('wifi_start', -1, imageBytes);
+    const ip = await startWifiTransfer(channel, wifi, imageBytes);
+    trace.record('wifi_up');
+    console.log(`📶 Device ${ip} is downloading ${wifi.url}`);
+    await done;
+    trace.record('complete', -1, imageBytes);
+    return true;
+  } finally {
+    if (timer) clearTimeout(timer);
+    subs.forEach(sub => sub.remove());
+    channel.close();
+  }
 }
+
+async function saveTrace(trace: OtaTraceRecorder, deviceId: string): Promise<string> {
+  await RNFS.mkdir(OTA_TRACE_DIR);
+  const stamp = new Date().toISOString().replace(/[:.]/g, '-');
+  const path = `${OTA_TRACE_DIR}/ota-${deviceId.replace(/[^\w-]/g, '')}-${stamp}.json`;
+  await RNFS.writeFile(path, JSON.stringify(trace.toJSON()), 'utf8');
+  console.log('📝 OTA trace saved:', path);
+  return path;
+}
+
 /* ---------------------------- Typescript Interface -------------------------------- */
+export interface ScanResult {
+    device: Device;
+    rssi: number | null; // null for simulated entries
+    lastSeen: number;
+}
+
+export type OtaOutcome = 'updated' | 'upToDate' | 'failed';
+
 export interface OTAStore {
     
     device: Device | null;
+    transport: OtaTransport | null;
     type: DeviceType | null;
+    deviceApp: OtaAppDesc | null; // firmware the connected device runs, if it reports it
+    deviceBoot: OtaBootProfile | null; // how that firmware's last boot went (OTA_HELPER_BOOT_PROFILE)
     isScanning: boolean;
-    foundDevices: Device[];
+    foundDevices: ScanResult[];
 
     isUpdating: boolean;
     progress: number;
+    stats: OtaStats | null;
+    lastTracePath: string | null;
+    lastOutcome: OtaOutcome | null;
 
     startScan: () => void;
     stopScan: () => void;
@@ -104,9 +325,13 @@ export interface OTAStore {
     otaUpdate: (
         base64Firmware: string, 
         chunkSize?: number,
+        window?: number,
+        force?: boolean, // send even when the device already runs this build
+        wifi?: OtaWifiOptions, // let the device download the image over Wi-Fi when it can
     ) => Promise<void>;
 
     loadFirmware: () => Promise<string>;
+    shareLastTrace: () => Promise<void>;
     requestPermissions: () => Promise<void>;
 }
 
@@ -114,39 +339,55 @@ export interface OTAStore {
 export const useOtaStore = create<OTAStore>()(
   subscribeWithSelector<OTAStore>((set, get) => ({
     device: null,
+    transport: null,
     type: null,
+    deviceApp: null,
+    deviceBoot: null,
     isScanning: false,
     foundDevices: [],
 
     isUpdating: false,
     progress: 0,
+    stats: null,
+    lastTracePath: null,
+    lastOutcome: null,
 
     startScan: async () => {
         const { requestPermissions, stopScan } = get();
         if (get().isScanning) return;
 
         await requestPermissions();
-        set({ isScanning: true, foundDevices: [] });
+        scanResults.clear();
+        if (__DEV__) simulatedScanEntries().forEach(r => scanResults.set(r.device.id, r));
+        set({ isScanning: true, foundDevices: Array.from(scanResults.values()) });
+
+        scanFlushTimer = setInterval(
+          () => flushScanResults(foundDevices => set({ foundDevices })),
+          SCAN_FLUSH_INTERVAL_MS
+        );
 
+        // service UUID filter runs in the native scanner, so unrelated
+        // advertisers never cross the bridge; one UUID per supported board
         BLE_MANAGER.startDeviceScan(
-          null,
-          { allowDuplicates: false },
+          [ESP32_ADVERTISE_UUID, RENESAS_SERVICE_UUID],
+          { allowDuplicates: true },
           (error, scannedDevice) => {
             if (error) {
               console.error('Scan error:', error.errorCode);
               stopScan();
               return;
             }
-            if (
-              scannedDevice &&
-              scannedDevice.isConnectable && 
-              scannedDevice.localName?.toLowerCase().includes('ota')
-            ) {
-              set(state => ({
-                foundDevices: state.foundDevices.some(d => d.id === scannedDevice.id)
-                  ? state.foundDevices
-                  : [...state.foundDevices, scannedDevice],
-              }));
+            if (!scannedDevice || !scannedDevice.isConnectable) return;
+
+            const prev = scanResults.get(scannedDevice.id);
+            scanResults.set(scannedDevice.id, {
+              device: scannedDevice,
+              rssi: scannedDevice.rssi,
+              lastSeen: Date.now(),
+            });
+            // RSSI jitter alone is not worth a re-render
+            if (!prev || Math.abs((prev.rssi ?? 0) - (scannedDevice.rssi ?? 0)) >= 5) {
+              scanDirty = true;
             }
           },
         );
@@ -154,33 +395,62 @@ export const useOtaStore = create<OTAStore>()(
 
     stopScan: () => {
       BLE_MANAGER.stopDeviceScan();
+      if (scanFlushTimer) clearInterval(scanFlushTimer);
+      scanFlushTimer = null;
+      scanResults.clear();
+      scanDirty = false;
       set({ isScanning: false, foundDevices: [] });
     },
 
     connectDevice: async deviceId => {
+      if (SIMULATION_TARGET_UUIDs.includes(deviceId)) {
+        const sim = new SimulatedOtaDevice({ id: deviceId });
+        lastConnect = { connectMs: 0, mtu: sim.mtu };
+        const deviceApp = await readDeviceApp(sim);
+        const deviceBoot = await readDeviceBoot(sim);
+        set({ device: null, type: null, transport: sim, deviceApp, deviceBoot, lastOutcome: null });
+        return;
+      }
+
+      const connectStart = Date.now();
       const isConnected = await BLE_MANAGER.isDeviceConnected(deviceId);
       let cd: Device;
 
       if (!isConnected) {
+        discoveredLinks.delete(deviceId);
         cd = await BLE_MANAGER.connectToDevice(deviceId, {
           autoConnect: false,
           timeout: 5000,
         });
-        await cd.discoverAllServicesAndCharacteristics();
       } else {
-        const devices = await BLE_MANAGER.connectedDevices([]);
+        // link kept from a previous session (e.g. failed OTA): reuse it and its discovery
+        const devices = await BLE_MANAGER.connectedDevices([ESP32_SERVICE_UUID, RENESAS_SERVICE_UUID]);
         const found = devices.find(d => d.id === deviceId);
         if (!found) throw new Error('Connected device not found');
         cd = found;
       }
+      await ensureDiscovered(cd);
 
       const profile = getDeviceProfile(cd.name ?? '');
       if (!profile) throw new Error('Unknown device type: ' + cd.name);
-      set({ device: cd, type: profile.type });
+      await checkGattLayout(cd, profile);
+      const hasCtrl = (await cd.services()).some(s => s.uuid.toLowerCase() === OTA_CTRL_SERVICE_UUID);
 
       if (Platform.OS === 'android') {
-        await BLE_MANAGER.requestMTUForDevice(cd.id, 500);
+        cd = await BLE_MANAGER.requestMTUForDevice(cd.id, 500);
+      }
+      lastConnect = { connectMs: Date.now() - connectStart, mtu: cd.mtu };
+      const transport = createBlePlxTransport(cd, profile, hasCtrl);
+      const deviceApp = await readDeviceApp(transport).catch(e => {
+        console.warn('Reading device app description failed:', e);
+        return null;
+      });
+      const deviceBoot = await readDeviceBoot(transport);
+      if (deviceBoot?.afterUpdate) {
+        console.log(`⏱️ ${transport.name} rebooted after the update: first action at ` +
+          `${deviceBoot.milestonesMs.firstAction?.toFixed(0) ?? '?'} ms, BLE at ${deviceBoot.milestonesMs.ble?.toFixed(0) ?? '?'} ms`);
       }
+      set({ device: cd, type: profile.type, transport, deviceApp, deviceBoot, lastOutcome: null });
     },
 
     disconnectDevice: async () => {
@@ -188,169 +458,143 @@ export const useOtaStore = create<OTAStore>()(
     },
 
     cancelConnection: async () => {
-      const d = get().device;
-      if (d) {
-        await d.cancelConnection();
-        set({ device: null, type: null });
+      const t = get().transport;
+      if (t) {
+        await t.disconnect();
+        set({ device: null, type: null, transport: null, deviceApp: null, deviceBoot: null });
       }
     },
 
     otaUpdate: async (
       base64Firmware,
       chunkSize = 492,
+      window = 1,
+      force = false,
+      wifi,
     ) => {
-        set ({ isUpdating: true, progress: 0 });
-        let cleanup = false;
-        const progressHandler = createProgressHandler(newPct => {
-            set({ progress: newPct });
-        });
-        let cmdSub: Subscription | null = null, recvSub: Subscription | null = null, 
-            cusSub: Subscription | null = null, progressSub: Subscription | null = null, 
-            disconnectSub: Subscription | null = null;
-        
-        let startResolve!: () => void;
-        let startReject!: (e: any) => void;
-        const startAck = new Promise<void>((res, rej) => {
-            startResolve = res;
-            startReject = rej;
-        });
-      
+        set ({ isUpdating: true, progress: 0, stats: null, lastOutcome: null });
+        let tracker: ReturnType<typeof createOtaStatsTracker> | null = null;
+        let trace: OtaTraceRecorder | null = null;
+        let keepLink = false;
+        const transport = get().transport;
         try {
-          const device = get().device;
-          if (!device) throw new Error('No device connected');
-        
-          const profile = getDeviceProfile(device.name ?? '');
-          if (!profile) throw new Error('Unknown device profile');
-        
-          if (!profile.serviceUUID || !profile.writeUUID ||
-              !profile.notifyUUID ||  !profile.commandUUID || !profile.customerUUID) {
-              throw new Error('Device profile is incomplete: ' + JSON.stringify(profile));
-          }
+          if (!transport) throw new Error('No device connected');
 
           const firmware = Buffer.from(base64Firmware, 'base64');
-          const totalLength = firmware.length;
-
-          disconnectSub = device.onDisconnected((e, d) => {
-              // disconnection during OTA update
-              // catch, finally will handle cleanup
-              if (!cleanup && e) {
-                console.error('OTA device disconnected. Try again.', e);
-              }
+          const manifest = await loadManifest(base64Firmware, firmware);
+          const { deviceApp } = get();
+          if (!force && deviceApp && manifest.app && isSameApp(deviceApp, manifest.app)) {
+            console.log(`✅ ${transport.name} already runs ${deviceApp.version}, skipping OTA`);
+            keepLink = true;
+            set({ lastOutcome: 'upToDate' });
+            return;
+          }
+          // short connection interval for the transfer, restored in finally
+          const priority = await setLinkPriority(transport, 'high');
+          trace = new OtaTraceRecorder({
+            deviceId: transport.id,
+            deviceName: transport.name,
+            simulated: transport.simulated,
+            platform: Platform.OS,
+            osVersion: String(Platform.Version),
+            firmwareBytes: firmware.length,
+            firmwareSha256: manifest.imageSha256,
+            appVersion: manifest.app?.version ?? null,
+            deviceAppVersion: deviceApp?.version ?? null,
+            mtu: transport.mtu,
+            chunkSize,
+            window,
+            connPriority: priority,
           });
-
-          recvSub = device.monitorCharacteristicForService(
-            profile.serviceUUID,
-            profile.writeUUID,
-            err => { 
-            if (!cleanup && err) {
-                console.error("OTA RECV_FW_CHAR subscription error:", err);
-                startReject(err); 
-            }
-            }
-          );
-          cusSub = device.monitorCharacteristicForService(
-            profile.serviceUUID,
-            profile.customerUUID,
-            err => { 
-            if (!cleanup && err) {
-                console.error("OTA CUSTOMER_CHAR subscription error:", err); 
-                startReject(err); 
-            }
-            }
-          );
-          cmdSub = device.monitorCharacteristicForService(
-            profile.serviceUUID,
-            profile.commandUUID,
-            (err, char) => {
-            if (!cleanup && err) {
-                console.error("OTA COMMAND_CHAR subscription error:", err);
-                return startReject(err);
-            }
-            if (char?.value) {
-                console.log('🔄 OTA Start CMD notify received');
-                startResolve();
-            }
-            }
-          );
-          progressSub = device.monitorCharacteristicForService(
-            profile.serviceUUID,
-            profile.notifyUUID,
-            (err, char) => {
-            if (!cleanup && err) {
-                console.error("OTA PROGRESS_CHAR subscription error:", err);
-                return progressHandler.rejectAll(err);
-            }
-            if (char?.value) {
-                const pct = Buffer.from(char.value, 'base64').readUInt8(0);
-                progressHandler.updateProgress(pct);
-            }
-            }
-          );
-
-          await sendStartOtaCommand(device, profile, totalLength);
-          await withTimeout(startAck, 3000, 'OTA start response timeout');
-
-          const numSectors = Math.ceil(totalLength / SECTOR_SIZE);
-          console.log(`Start Sending firmware chunks... MTU: ${chunkSize}, Sectors: ${numSectors}, Total Length: ${totalLength} bytes`);
-          for (let sector = 0; sector < numSectors; sector++) {
-            const offset = sector * SECTOR_SIZE; // 0
-            const sectorChunk = firmware.subarray(
-            offset,
-            Math.min(offset + SECTOR_SIZE, totalLength)
-            ); // 4096
-            const crc = calcCrc16(sectorChunk);
-
-            const header = Buffer.alloc(3);
-            header.writeUInt16LE(sector, 0);
-
-            const numSeq = Math.ceil(sectorChunk.length / chunkSize);
-            for (let seq = 0; seq < numSeq; seq++) {
-                const slice = sectorChunk.subarray(
-                seq * chunkSize,
-                Math.min((seq + 1) * chunkSize, sectorChunk.length)
+          if (lastConnect) {
+            trace.record('connect', -1, lastConnect.connectMs);
+            trace.record('mtu', -1, lastConnect.mtu);
+          }
+          if (Platform.OS === 'android') trace.record('conn_priority', -1, priority ? 1 : -1);
+
+          if (wifi) {
+            const wifiTracker = createOtaStatsTracker(
+              firmware.length,
+              { mtu: transport.mtu, chunkSize, window, priority },
+              stats => {
+                set({ stats, progress: stats.progress });
+                updateForegroundProgress(stats.progress, stats.avgKBps);
+              }
             );
-              const isLast = seq === numSeq - 1;
-              const packet = Buffer.alloc(3 + slice.length + (isLast ? 2 : 0));
-              header.writeUInt8((isLast ? 0xFF : seq), 2);
-              header.copy(packet, 0);
-              packet.set(slice, 3);
-              if (isLast) packet.writeUInt16LE(crc, 3 + slice.length);
-
-              await device.writeCharacteristicWithResponseForService(
-                profile.serviceUUID,
-                profile.writeUUID,
-                packet.toString('base64')
-              );
+            tracker = wifiTracker;
+            const tr = trace;
+            let confirmed = 0;
+            const sent = await runInForegroundService(() =>
+              runWifiTransfer(transport, firmware.length, wifi, pct => {
+                // only the device sees the bytes; throughput follows its progress
+                const bytes = Math.floor((firmware.length * pct) / 100);
+                wifiTracker.onProgress(pct);
+                wifiTracker.onSectorConfirmed(bytes - confirmed);
+                confirmed = bytes;
+              }, tr)
+            );
+            if (sent) {
+              set({ lastOutcome: 'updated' });
+              return;
             }
-
-            console.log(`📦 Sector ${sector + 1}/${numSectors} sent`);
-            const endOffset = offset + sectorChunk.length;
-            const expectedPct = Math.floor((endOffset / totalLength) * 100);
-            await withTimeout(
-              progressHandler.waitForProgress(expectedPct),
-              5000,
-              `Progress wait timeout at ${expectedPct}%`
-            ); 
+            console.warn(`Device offers no ${wifi.mode} Wi-Fi transfer, using BLE`);
+            tracker.stop();
+            tracker = null;
           }
 
-          await withTimeout(
-            progressHandler.waitForProgress(100),
-            5000,
-            'Final progress wait timeout'
+          const { payload, sectorCrcs, crc32, copiedSectors } = await planTransfer(transport, firmware, manifest, trace);
+          if (payload.length === 0) {
+            console.log('✅ Device already runs this image, nothing to send');
+            keepLink = true;
+            set({ lastOutcome: 'upToDate' });
+            return;
+          }
+          tracker = createOtaStatsTracker(
+            payload.length,
+            { mtu: transport.mtu, chunkSize, window, priority },
+            // progress and stats reach React only through this capped publish
+            stats => {
+              set({ stats, progress: stats.progress });
+              updateForegroundProgress(stats.progress, stats.avgKBps);
+            }
+          );
+          const t = tracker;
+          const tr = trace;
+          let linkRead = !transport.hasCtrl;
+          // hosted in a foreground service so a locked screen does not throttle it
+          await runInForegroundService(() =>
+            runOtaTransfer(transport, payload, { chunkSize, window, crc32, sectorCrcs, copiedSectors }, {
+              onProgress: pct => t.onProgress(pct),
+              onSectorSent: (_, bytes) => t.onSectorSent(bytes),
+              onSectorConfirmed: (sector, bytes) => {
+                t.onSectorConfirmed(bytes);
+                if (!linkRead && sector >= LINK_GRANT_SECTOR) {
+                  linkRead = true;
+                  recordLinkGrant(transport, t, tr).catch(e => console.warn('Reading link parameters failed:', e));
+                }
+              },
+              onRewind: (_, bytes, retransmits) => t.onRewind(bytes, retransmits),
+              trace: tr,
+            })
           );
-          console.log('✅ OTA update completed successfully');
+          set({ lastOutcome: 'updated' });
         } catch (e) {
           console.error('OTA update failed:', e);
-          startReject?.(e);
-          progressHandler?.rejectAll(e);
+          set({ lastOutcome: 'failed' });
+          // keep a healthy link so a retry skips connect and discovery
+          keepLink = !!transport && await transport.isConnected().catch(() => false);
         } finally {
-          cleanup = true
-          set({ device: null, type: null, isUpdating: false, progress: 0 });
-          disconnectSub?.remove();
-          cmdSub?.remove();
-          recvSub?.remove();
-          cusSub?.remove();
-          progressSub?.remove();
+          tracker?.stop();
+          if (trace && transport) {
+            saveTrace(trace, transport.id)
+              .then(path => set({ lastTracePath: path }))
+              .catch(e => console.error('Saving OTA trace failed:', e));
+          }
+          if (keepLink) {
+            setLinkPriority(transport!, 'balanced');
+            set({ isUpdating: false, progress: 0, stats: null });
+          }
+          else set({ device: null, type: null, transport: null, deviceApp: null, deviceBoot: null, isUpdating: false, progress: 0, stats: null });
         }
     },
   
@@ -359,6 +603,15 @@ export const useOtaStore = create<OTAStore>()(
       return firmware;
     },
     
+    shareLastTrace: async () => {
+      const path = get().lastTracePath;
+      if (!path) return;
+      const json = await RNFS.readFile(path, 'utf8');
+      await Share.share(
+        Platform.OS === 'ios' ? { url: `file://${path}` } : { title: 'OTA trace', message: json }
+      );
+    },
+
     requestPermissions: async () => {
       if (Platform.OS === 'android') {
         await PermissionsAndroid.requestMultiple([
@@ -0,0 +1,103 @@
+/* ----------------------------- Constants ---------------------------------------- */
+export const OTA_TRACE_VERSION = 1;
+const DEFAULT_CAPACITY = 8192; // events, oldest are overwritten once full
+
+export const OTA_TRACE_EVENTS = [
+  'connect',           // value: connect + discovery time (ms)
+  'mtu',               // value: negotiated ATT MTU
+  'conn_priority',     // value: 1 high, 0 balanced, -1 request failed (what the app asked for)
+  'link_grant',        // value: connection interval the device reports (ms)
+  'diff_start',        // value: image sectors
+  'diff_done',         // value: changed sectors that will cross BLE
+  'wifi_start',        // value: image bytes the device downloads itself
+  'wifi_up',           // device joined Wi-Fi and started the download
+  'start_cmd',
+  'start_ack',
+  'sector_send_start',
+  'sector_send_end',   // value: sector bytes
+  'sector_ack',        // progress confirmed the sector was written to flash
+  'sector_nack',       // value: ble_ota ack status
+  'rewind',            // value: retransmits so far
+  'error',             // value: index into `errors`
+  'complete',          // value: image bytes
+] as const;
+
+export type OtaTraceEvent = typeof OTA_TRACE_EVENTS[number];
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+export interface OtaTraceFile {
+  version: number;
+  meta: Record<string, string | number | boolean | null>;
+  startedAt: string;        // ISO wall clock of t = 0
+  events: OtaTraceEvent[];  // name table for the `kind` column
+  // [t_ms, kind, sector, value], t relative to startedAt, sector -1 if n/a
+  timeline: [number, number, number, number][];
+  errors: string[];
+  dropped: number;          // events overwritten because the ring was full
+}
+
+/* ----------------------------- helper functions --------------------------------- */
+const now = (): number =>
+  typeof performance !== 'undefined' ? performance.now() : Date.now();
+
+/* ---------------------------- Recorder -------------------------------------------- */
+// Fixed-size ring of numeric columns, cheap enough to record from the
+// transfer loop on every sector without allocating per event.
+export class OtaTraceRecorder {
+  readonly meta: OtaTraceFile['meta'];
+
+  private readonly t0 = now();
+  private readonly wallStart = new Date();
+  private readonly capacity: number;
+  private readonly time: Float64Array;
+  private readonly kind: Uint8Array;
+  private readonly sector: Int32Array;
+  private readonly value: Float64Array;
+  private readonly errors: string[] = [];
+  private head = 0;
+  private count = 0;
+  private dropped = 0;
+
+  constructor(meta: OtaTraceFile['meta'] = {}, capacity = DEFAULT_CAPACITY) {
+    this.meta = { ...meta };
+    this.capacity = capacity;
+    this.time = new Float64Array(capacity);
+    this.kind = new Uint8Array(capacity);
+    this.sector = new Int32Array(capacity);
+    this.value = new Float64Array(capacity);
+  }
+
+  record(event: OtaTraceEvent, sector = -1, value = 0) {
+    const i = this.head;
+    this.time[i] = now() - this.t0;
+    this.kind[i] = OTA_TRACE_EVENTS.indexOf(event);
+    this.sector[i] = sector;
+    this.value[i] = value;
+    this.head = (i + 1) % this.capacity;
+    if (this.count < this.capacity) this.count++;
+    else this.dropped++;
+  }
+
+  error(err: unknown, sector = -1) {
+    this.errors.push(String(err));
+    this.record('error', sector, this.errors.length - 1);
+  }
+
+  toJSON(): OtaTraceFile {
+    const timeline: OtaTraceFile['timeline'] = [];
+    const first = (this.head - this.count + this.capacity) % this.capacity;
+    for (let n = 0; n < this.count; n++) {
+      const i = (first + n) % this.capacity;
+      timeline.push([Math.round(this.time[i] * 100) / 100, this.kind[i], this.sector[i], this.value[i]]);
+    }
+    return {
+      version: OTA_TRACE_VERSION,
+      meta: this.meta,
+      startedAt: this.wallStart.toISOString(),
+      events: [...OTA_TRACE_EVENTS],
+      timeline,
+      errors: this.errors,
+      dropped: this.dropped,
+    };
+  }
+}
@@ -0,0 +1,415 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Buffer } from 'buffer';
+import { OtaSubscription, OtaTransport } from './otaTransport';
+import { OtaTraceRecorder } from './otaTrace';
+
+/* ----------------------------- Constants ---------------------------------------- */
+export const SECTOR_SIZE = 4096; // 4KB
+const START_ACK_TIMEOUT_MS = 3000;
+const SECTOR_ACK_TIMEOUT_MS = 5000;
+// a diff session copies its unchanged sectors before the first received one
+// is written (read + write of 4 KB, with margin for an erase)
+const COPY_MS_PER_SECTOR = 60;
+const SECTOR_MAX_RETRIES = 3;      // resend attempts per sector before aborting the session
+const SECTOR_RETRY_BACKOFF_MS = 250; // doubled on every retry
+// BUSY is flow control, not a failure: resent after a fixed pause that does
+// not use up the retries, up to ~10 s of full queue in a row
+const SECTOR_BUSY_DELAY_MS = 50;
+const SECTOR_MAX_BUSY_WAITS = 200;
+
+// RECV_FW_CHAR sector ack status (ble_ota): 0 ok, 1 crc error, 2 sector index error, 3 length error
+export const SECTOR_ACK_OK = 0x0000;
+export const SECTOR_ACK_CRC_ERROR = 0x0001;
+export const SECTOR_ACK_INDEX_ERROR = 0x0002;
+// CRC32 sector char only: the sector could not be queued, resend it
+export const SECTOR_ACK_BUSY = 0x0004;
+
+/* ----------------------------- helper functions --------------------------------- */
+export function calcCrc16(buffer: Buffer): number {
+  let crc = 0;
+  for (let i = 0; i < buffer.length; i++) {
+    crc ^= buffer[i] << 8;
+    for (let j = 0; j < 8; j++) {
+      if (crc & 0x8000) crc = ((crc << 1) ^ 0x1021) & 0xffff;
+      else crc = (crc << 1) & 0xffff;
+    }
+  }
+  return crc;
+}
+
+// IEEE 802.3, reflected, as zlib crc32() and the device's esp_rom_crc32_le(0, ...)
+const CRC32_TABLE = (() => {
+  const table = new Uint32Array(256);
+  for (let i = 0; i < 256; i++) {
+    let c = i;
+    for (let j = 0; j < 8; j++) c = c & 1 ? (c >>> 1) ^ 0xedb88320 : c >>> 1;
+    table[i] = c >>> 0;
+  }
+  return table;
+})();
+
+export function calcCrc32(buffer: Uint8Array): number {
+  let crc = 0xffffffff;
+  for (let i = 0; i < buffer.length; i++) {
+    crc = CRC32_TABLE[(crc ^ buffer[i]) & 0xff] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xffffffff) >>> 0;
+}
+
+function makeOtaStartCmd(fwLength: number): Buffer {
+  const packet = Buffer.alloc(20, 0x00);
+  packet.writeUInt16LE(0x0001, 0);              // Command ID
+  packet.writeUInt32LE(fwLength, 2);            // Firmware length
+  const crc = calcCrc16(packet.subarray(0, 18));
+  packet.writeUInt16LE(crc, 18);                // CRC16
+  return packet;
+}
+
+async function sendStartOtaCommand(transport: OtaTransport, fwLength: number): Promise<void> {
+    await transport.write('command', makeOtaStartCmd(fwLength));
+    console.log('🔄 OTA Start CMD sent (fw_length=', fwLength, ')');
+}
+
+export function withTimeout<T>(promise: Promise<T>, ms: number, errorMsg = 'Operation timed out'): Promise<T> {
+  return new Promise((resolve, reject) => {
+    const timer = setTimeout(() => reject(new Error(errorMsg)), ms);
+    promise
+      .then(res => resolve(res))
+      .catch(err => reject(err))
+      .finally(() => clearTimeout(timer));
+  });
+}
+
+export const delay = (ms: number) => new Promise<void>(res => setTimeout(res, ms));
+
+export interface SectorAck {
+  sector: number;
+  status: number;
+  expected: number; // sector index the device is waiting for (valid on INDEX_ERROR)
+}
+
+export function parseSectorAck(buf: Buffer): SectorAck | null {
+  if (buf.length < 6) return null;
+  return {
+    sector: buf.readUInt16LE(0),
+    status: buf.readUInt16LE(2),
+    expected: buf.readUInt16LE(4),
+  };
+}
+
+// Turns negative sector acks into rejections so a bad sector is resent
+// immediately instead of waiting for the progress timeout.
+function createSectorAckHandler(trace?: OtaTraceRecorder) {
+  let reject: ((e: Error) => void) | null = null;
+  let resume: number | null = null;
+  let busy = false;
+
+  const onAck = (ack: SectorAck) => {
+    if (!reject || ack.status === SECTOR_ACK_OK) return;
+    trace?.record('sector_nack', ack.sector, ack.status);
+    // sectors before the failing one were accepted by ble_ota, which only
+    // takes them in order
+    resume = ack.status === SECTOR_ACK_INDEX_ERROR ? ack.expected : ack.sector;
+    busy = ack.status === SECTOR_ACK_BUSY;
+    const r = reject;
+    reject = null;
+    r(new Error(`Sector ${ack.sector} nack (status=${ack.status}, expected=${ack.expected})`));
+  };
+
+  const arm = () => {
+    resume = null;
+    busy = false;
+    const nack = new Promise<never>((_, rej) => { reject = rej; });
+    nack.catch(() => {});
+    return nack;
+  };
+
+  const disarm = () => { reject = null; };
+  const takeNack = () => {
+    const n = { resume, busy };
+    resume = null;
+    busy = false;
+    return n;
+  };
+
+  return { onAck, arm, disarm, takeNack };
+}
+
+function createProgressHandler(onProgress?: (pct: number) => void) {
+  let current = 0;
+  let waiters: { pct: number; resolve: () => void; reject: (e?: any) => void }[] = [];
+
+  const updateProgress = (newPct: number) => {
+    if (newPct > current) {
+      console.log(`🔄 OTA 진행률: ${current}% -> ${newPct}%`);
+      current = newPct;
+      onProgress?.(current);
+      waiters = waiters.filter(w => {
+        if (current >= w.pct) { w.resolve(); return false; }
+        return true;
+      });
+    }
+  };
+
+  const waitForProgress = (pct: number) =>
+    new Promise<void>((res, rej) => {
+      if (current >= pct) return res();
+      waiters.push({ pct, resolve: res, reject: rej });
+    });
+
+  const rejectAll = (reason: any) => { waiters.forEach(w => w.reject(reason)); waiters = []; };
+
+  return { updateProgress, waitForProgress, rejectAll };
+}
+
+async function writeSector(
+    transport: OtaTransport,
+    sector: number,
+    sectorChunk: Buffer,
+    crc: number,
+    chunkSize: number,
+    crc32: boolean,
+): Promise<void> {
+    const char = crc32 ? 'recvFw32' : 'recvFw';
+    const crcBytes = crc32 ? 4 : 2;
+    const header = Buffer.alloc(3);
+    header.writeUInt16LE(sector, 0);
+
+    const numSeq = Math.ceil(sectorChunk.length / chunkSize);
+    for (let seq = 0; seq < numSeq; seq++) {
+      const slice = sectorChunk.subarray(
+        seq * chunkSize,
+        Math.min((seq + 1) * chunkSize, sectorChunk.length)
+      );
+      const isLast = seq === numSeq - 1;
+      const packet = Buffer.alloc(3 + slice.length + (isLast ? crcBytes : 0));
+      header.writeUInt8((isLast ? 0xFF : seq), 2);
+      header.copy(packet, 0);
+      packet.set(slice, 3);
+      if (isLast && crc32) packet.writeUInt32LE(crc, 3 + slice.length);
+      else if (isLast) packet.writeUInt16LE(crc, 3 + slice.length);
+
+      await transport.write(char, packet);
+    }
+}
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+export interface OtaTransferOptions {
+    chunkSize?: number; // firmware bytes per RECV_FW write (ATT MTU - 8)
+    window?: number;    // sectors sent ahead of the last progress-confirmed one
+    // sectors go to ota_helper's CRC32 char instead of RECV_FW; the firmware
+    // must have accepted CTRL_OP_SECTOR_CRC32 first
+    crc32?: boolean;
+    // precomputed per-sector CRCs of the chosen width (OtaManifest.sectorCrc16 / sectorCrc32)
+    sectorCrcs?: readonly number[];
+    // sectors the device copies from its running image under a diff plan;
+    // the first sector's confirmation waits for them
+    copiedSectors?: number;
+}
+
+export interface OtaTransferHooks {
+    onProgress?: (pct: number) => void;
+    onSectorSent?: (sector: number, bytes: number) => void;
+    onSectorConfirmed?: (sector: number, bytes: number) => void;
+    // sectors already sent from `sector` on are dropped and will be resent
+    onRewind?: (sector: number, bytes: number, retransmits: number) => void;
+    trace?: OtaTraceRecorder;
+}
+
+export interface OtaTransferResult {
+    bytes: number;
+    sectors: number;
+    retransmits: number; // sectors sent more than once
+    elapsedMs: number;
+}
+
+/* ---------------------------- Transfer -------------------------------------------- */
+// Streams firmware over the ble_ota sector protocol. Sectors are sent
+// go-back-N: up to `window` ahead of the oldest one not yet confirmed by a
+// progress notification; a nack or timeout resends from the failing index.
+export async function runOtaTransfer(
+    transport: OtaTransport,
+    firmware: Buffer,
+    { chunkSize = 492, window = 1, crc32 = false, sectorCrcs, copiedSectors = 0 }: OtaTransferOptions = {},
+    hooks: OtaTransferHooks = {},
+): Promise<OtaTransferResult> {
+    let cleanup = false;
+    let linkError: Error | null = null;
+    const progressHandler = createProgressHandler(hooks.onProgress);
+    const { trace } = hooks;
+    const sectorAcks = createSectorAckHandler(trace);
+    const subs: OtaSubscription[] = [];
+
+    let startResolve!: () => void;
+    let startReject!: (e: any) => void;
+    const startAck = new Promise<void>((res, rej) => {
+        startResolve = res;
+        startReject = rej;
+    });
+    startAck.catch(() => {});
+
+    const startedAt = Date.now();
+    const totalLength = firmware.length;
+    const numSectors = Math.ceil(totalLength / SECTOR_SIZE);
+    let retransmits = 0;
+
+    try {
+      subs.push(transport.onDisconnected(e => {
+          // disconnection during OTA update
+          if (cleanup) return;
+          console.error('OTA device disconnected. Try again.', e);
+          linkError = e ?? new Error('Device disconnected');
+          startReject(linkError);
+          progressHandler.rejectAll(linkError);
+      }));
+
+      subs.push(transport.monitor(crc32 ? 'recvFw32' : 'recvFw', (err, value) => {
+          if (!cleanup && err) {
+              console.error("OTA sector ack subscription error:", err);
+              return startReject(err);
+          }
+          const ack = value && parseSectorAck(value);
+          if (ack) sectorAcks.onAck(ack);
+      }));
+      subs.push(transport.monitor('customer', err => {
+          if (!cleanup && err) {
+              console.error("OTA CUSTOMER_CHAR subscription error:", err);
+              startReject(err);
+          }
+      }));
+      subs.push(transport.monitor('command', (err, value) => {
+          if (!cleanup && err) {
+              console.error("OTA COMMAND_CHAR subscription error:", err);
+              return startReject(err);
+          }
+          if (value) {
+              console.log('🔄 OTA Start CMD notify received');
+              startResolve();
+          }
+      }));
+      subs.push(transport.monitor('progress', (err, value) => {
+          if (!cleanup && err) {
+              console.error("OTA PROGRESS_CHAR subscription error:", err);
+              return progressHandler.rejectAll(err);
+          }
+          if (value) progressHandler.updateProgress(value.readUInt8(0));
+      }));
+
+      trace?.record('start_cmd');
+      await sendStartOtaCommand(transport, totalLength);
+      await withTimeout(startAck, START_ACK_TIMEOUT_MS, 'OTA start response timeout');
+      trace?.record('start_ack');
+
+      console.log(`Start Sending firmware chunks... MTU: ${chunkSize}, Window: ${window}, Sectors: ${numSectors}, Total Length: ${totalLength} bytes, ${crc32 ? 'CRC32' : 'CRC16'}`);
+      if (sectorCrcs && sectorCrcs.length !== numSectors) {
+        throw new Error(`Manifest has ${sectorCrcs.length} sector CRCs, image has ${numSectors} sectors`);
+      }
+      // computed on first send when no manifest was given
+      const crcs: (number | undefined)[] = sectorCrcs ? [...sectorCrcs] : new Array(numSectors);
+      const sectorAt = (s: number) =>
+        firmware.subarray(s * SECTOR_SIZE, Math.min((s + 1) * SECTOR_SIZE, totalLength));
+      const bytesBetween = (from: number, to: number) =>
+        Math.max(0, Math.min(to * SECTOR_SIZE, totalLength) - from * SECTOR_SIZE);
+      const expectedPct = (s: number) =>
+        Math.floor((Math.min((s + 1) * SECTOR_SIZE, totalLength) / totalLength) * 100);
+
+      let base = 0;    // oldest sector not yet confirmed
+      let next = 0;    // next sector to put on the air
+      let attempt = 0; // retries spent on `base`
+      let busyWaits = 0; // BUSY acks in a row
+      while (base < numSectors) {
+        const nack = sectorAcks.arm();
+        try {
+          while (next < numSectors && next - base < window) {
+            const chunk = sectorAt(next);
+            const crc = crcs[next] ?? (crcs[next] = crc32 ? calcCrc32(chunk) : calcCrc16(chunk));
+            trace?.record('sector_send_start', next);
+            await writeSector(transport, next, chunk, crc, chunkSize, crc32);
+            trace?.record('sector_send_end', next, chunk.length);
+            hooks.onSectorSent?.(next, chunk.length);
+            next++;
+          }
+          await withTimeout(
+            Promise.race([progressHandler.waitForProgress(expectedPct(base)), nack]),
+            SECTOR_ACK_TIMEOUT_MS + (base === 0 ? copiedSectors * COPY_MS_PER_SECTOR : 0),
+            `Progress wait timeout at ${expectedPct(base)}%`
+          );
+          console.log(`📦 Sector ${base + 1}/${numSectors} sent`);
+          trace?.record('sector_ack', base);
+          hooks.onSectorConfirmed?.(base, bytesBetween(base, base + 1));
+          base++;
+          attempt = 0;
+          busyWaits = 0;
+        } catch (e) {
+          if (linkError) throw linkError;
+          trace?.error(e, base);
+          const { resume, busy } = sectorAcks.takeNack();
+          if (resume !== null && resume > base && resume <= numSectors) {
+            // everything before `resume` is queued (lost ack): the CRC32 channel
+            // acks a full queue BUSY, and a RECV_FW sector the queue cannot take
+            // ends the session on the device
+            console.warn(`↪️ Device expects sector ${resume}, resuming from there`);
+            hooks.onSectorConfirmed?.(base, bytesBetween(base, Math.min(resume, next)));
+            if (resume < next) {
+              retransmits += next - resume;
+              trace?.record('rewind', resume, retransmits);
+              hooks.onRewind?.(resume, bytesBetween(resume, next), retransmits);
+            }
+            base = next = resume;
+            attempt = 0;
+            if (!busy) {
+              busyWaits = 0;
+              continue;
+            }
+          }
+          if (busy) {
+            if (++busyWaits > SECTOR_MAX_BUSY_WAITS) {
+              throw new Error(`Sector ${base} refused, device queue full for ${SECTOR_MAX_BUSY_WAITS} tries`);
+            }
+            if (next > base) {
+              retransmits += next - base;
+              trace?.record('rewind', base, retransmits);
+              hooks.onRewind?.(base, bytesBetween(base, next), retransmits);
+              next = base;
+            }
+            await delay(SECTOR_BUSY_DELAY_MS);
+            continue;
+          }
+
+          // 같은 sector index로 재전송, 실패가 반복될 때만 세션 전체를 중단
+          if (++attempt > SECTOR_MAX_RETRIES) {
+            throw new Error(`Sector ${base} failed after ${SECTOR_MAX_RETRIES} retries: ${e}`);
+          }
+          if (resume !== null && resume < base) base = resume;
+          retransmits += next - base;
+          trace?.record('rewind', base, retransmits);
+          hooks.onRewind?.(base, bytesBetween(base, next), retransmits);
+          next = base;
+
+          const backoff = SECTOR_RETRY_BACKOFF_MS * 2 ** (attempt - 1);
+          console.warn(`🔁 Sector ${base} retry ${attempt}/${SECTOR_MAX_RETRIES} in ${backoff}ms:`, e);
+          await delay(backoff);
+        } finally {
+          sectorAcks.disarm();
+        }
+      }
+
+      await withTimeout(
+        progressHandler.waitForProgress(100),
+        SECTOR_ACK_TIMEOUT_MS,
+        'Final progress wait timeout'
+      );
+      console.log('✅ OTA update completed successfully');
+      trace?.record('complete', -1, totalLength);
+
+      return { bytes: totalLength, sectors: numSectors, retransmits, elapsedMs: Date.now() - startedAt };
+    } catch (e) {
+      trace?.error(e);
+      startReject?.(e);
+      progressHandler.rejectAll(e);
+      throw e;
+    } finally {
+      cleanup = true;
+      subs.forEach(s => s.remove());
+    }
+}
@@ -0,0 +1,119 @@
+/* ----------------------------- Imports ----------------------------------------- */
+import { Buffer } from 'buffer';
+import type { Device } from 'react-native-ble-plx';
+import type { DeviceProfile } from './deviceStore';
+
+/* ---------------------------- Typescript Interface -------------------------------- */
+// OTA GATT characteristics, named after the ESP32 ble_ota service;
+// 'ctrl', 'info', 'recvFw32' and 'boot' belong to the separate ota_helper control service
+export type OtaChar = 'recvFw' | 'progress' | 'command' | 'customer' | 'ctrl' | 'info' | 'recvFw32' | 'boot';
+
+export const OTA_CTRL_SERVICE_UUID = '00008030-0000-1000-8000-00805f9b34fb'; //0x8030
+export const OTA_CTRL_CHAR_UUID    = '00008031-0000-1000-8000-00805f9b34fb'; //0x8031
+export const OTA_INFO_CHAR_UUID    = '00008032-0000-1000-8000-00805f9b34fb'; //0x8032
+export const OTA_SECTOR32_CHAR_UUID = '00008033-0000-1000-8000-00805f9b34fb'; //0x8033
+export const OTA_BOOT_CHAR_UUID    = '00008034-0000-1000-8000-00805f9b34fb'; //0x8034, OTA_HELPER_BOOT_PROFILE
+
+export interface OtaSubscription {
+  remove: () => void;
+}
+
+export type OtaCharListener = (err: Error | null, value: Buffer | null) => void;
+
+// Android connection priority; 'high' asks for an ~7.5-15 ms connection interval
+export type OtaConnectionPriority = 'balanced' | 'high' | 'lowPower';
+
+// Everything otaTransfer needs from a link. Keeps the transfer loop free of
+// react-native imports so it also runs under Node against the simulator.
+export interface OtaTransport {
+  readonly id: string;
+  readonly name: string;
+  readonly simulated: boolean;
+  readonly mtu: number; // negotiated ATT MTU
+  readonly hasCtrl: boolean; // firmware exposes the ota_helper control service
+
+  write: (char: OtaChar, data: Buffer) => Promise<void>;
+  read: (char: OtaChar) => Promise<Buffer>;
+  monitor: (char: OtaChar, listener: OtaCharListener) => OtaSubscription;
+  onDisconnected: (listener: (err: Error | null) => void) => OtaSubscription;
+  isConnected: () => Promise<boolean>;
+  disconnect: () => Promise<void>;
+  // absent when the link cannot be tuned (simulator)
+  requestConnectionPriority?: (priority: OtaConnectionPriority) => Promise<void>;
+}
+
+// ble-plx ConnectionPriority values, inlined to keep this file free of native imports
+const CONNECTION_PRIORITY: Record<OtaConnectionPriority, number> = {
+  balanced: 0,
+  high: 1,
+  lowPower: 2,
+};
+
+/* ---------------------------- react-native-ble-plx -------------------------------- */
+export function createBlePlxTransport(
+  device: Device,
+  profile: DeviceProfile,
+  hasCtrl = false,
+): OtaTransport {
+  const uuids: Record<OtaChar, string | undefined> = {
+    recvFw: profile.writeUUID,
+    progress: profile.notifyUUID,
+    command: profile.commandUUID,
+    customer: profile.customerUUID,
+    ctrl: hasCtrl ? OTA_CTRL_CHAR_UUID : undefined,
+    info: hasCtrl ? OTA_INFO_CHAR_UUID : undefined,
+    recvFw32: hasCtrl ? OTA_SECTOR32_CHAR_UUID : undefined,
+    boot: hasCtrl ? OTA_BOOT_CHAR_UUID : undefined,
+  };
+  const isCtrl = (char: OtaChar) => char === 'ctrl' || char === 'info' || char === 'recvFw32' || char === 'boot';
+  const serviceOf = (char: OtaChar): string =>
+    isCtrl(char) ? OTA_CTRL_SERVICE_UUID : profile.serviceUUID;
+  const uuidOf = (char: OtaChar): string => {
+    const uuid = uuids[char];
+    if (isCtrl(char) && !uuid) throw new Error('Device has no OTA control service');
+    if (!profile.serviceUUID || !uuid) {
+      throw new Error('Device profile is incomplete: ' + JSON.stringify(profile));
+    }
+    return uuid;
+  };
+
+  return {
+    id: device.id,
+    name: device.localName || device.name || device.id,
+    simulated: false,
+    mtu: device.mtu,
+    hasCtrl,
+
+    write: async (char, data) => {
+      await device.writeCharacteristicWithResponseForService(
+        serviceOf(char),
+        uuidOf(char),
+        data.toString('base64')
+      );
+    },
+
+    read: async char => {
+      const c = await device.readCharacteristicForService(serviceOf(char), uuidOf(char));
+      return Buffer.from(c.value ?? '', 'base64');
+    },
+
+    monitor: (char, listener) =>
+      device.monitorCharacteristicForService(
+        serviceOf(char),
+        uuidOf(char),
+        (err, c) => listener(err, c?.value ? Buffer.from(c.value, 'base64') : null)
+      ),
+
+    onDisconnected: listener => device.onDisconnected(err => listener(err)),
+
+    isConnected: () => device.isConnected(),
+
+    requestConnectionPriority: async priority => {
+      await device.requestConnectionPriority(CONNECTION_PRIORITY[priority]);
+    },
+
+    disconnect: async () => {
+      await device.cancelConnection();
+    },
+  };
+}
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+static const char *TAG = "esp_ota_ops";
+
+#define HOST_IMAGE_MAGIC                    0xE9
+#define HOST_SECTOR_SIZE                    4096
+
+// one update at a time, as ota_core runs it
+static struct {
+    esp_ota_handle_t handle;
+    const esp_partition_t *partition;
+    uint32_t wrote_size;
+} s_ota;
+static esp_ota_handle_t s_last_handle;
+
+const esp_partition_t *
+esp_ota_get_running_partition(void)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+}
+
+const esp_partition_t *
+esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+}
+
+esp_err_t
+esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    if (!partition || !ota_state) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t
+esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    return ESP_OK;
+}
+
+// like app_update: an unknown size erases the whole partition up front
+esp_err_t
+esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    if (!partition || !out_handle || s_ota.handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t erase_len = partition->size;
+    if (image_size != OTA_SIZE_UNKNOWN) {
+        erase_len = (image_size + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE * HOST_SECTOR_SIZE;
+    }
+    esp_err_t err = esp_partition_erase_range(partition, 0, erase_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_ota.handle = ++s_last_handle;
+    s_ota.partition = partition;
+    s_ota.wrote_size = 0;
+    *out_handle = s_ota.handle;
+    return ESP_OK;
+}
+
+esp_err_t
+esp_ota_write_with_offset(esp_ota_handle_t handle, const void *data, size_t size, uint32_t offset)
+{
+    if (!handle || handle != s_ota.handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = esp_partition_write(s_ota.partition, offset, data, size);
+    if (err == ESP_OK) {
+        s_ota.wrote_size += size;
+    }
+    return err;
+}
+
+esp_err_t
+esp_ota_end(esp_ota_handle_t handle)
+{
+    uint8_t magic = 0;
+
+    if (!handle || handle != s_ota.handle) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    const esp_partition_t *partition = s_ota.partition;
+    uint32_t wrote_size = s_ota.wrote_size;
+    memset(&s_ota, 0, sizeof(s_ota));
+
+    if (wrote_size == 0 || esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != HOST_IMAGE_MAGIC) {
+        ESP_LOGE(TAG, "image in %s does not validate", partition->label);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    return ESP_OK;
+}
+
+esp_err_t
+esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    if (!partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // there is no otadata to switch on the host, ota_host checks ota_1 itself
+    ESP_LOGI(TAG, "next boot from %s", partition->label);
+    return ESP_OK;
+}
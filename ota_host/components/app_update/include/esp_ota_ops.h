@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// The subset of app_update's esp_ota_ops.h that ota_core uses, over the
+// emulated flash of the linux target: ota_0 runs, ota_1 takes the update.
+// esp_ota_end() checks the image header magic instead of a full
+// esp_image_verify(), which needs the bootloader support code.
+
+#define OTA_SIZE_UNKNOWN                    0xffffffff
+#define ESP_ERR_OTA_BASE                    0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED         (ESP_ERR_OTA_BASE + 0x03)
+
+typedef uint32_t esp_ota_handle_t;
+
+typedef enum {
+    ESP_OTA_IMG_NEW             = 0x0U,
+    ESP_OTA_IMG_PENDING_VERIFY  = 0x1U,
+    ESP_OTA_IMG_VALID           = 0x2U,
+    ESP_OTA_IMG_INVALID         = 0x3U,
+    ESP_OTA_IMG_ABORTED         = 0x4U,
+    ESP_OTA_IMG_UNDEFINED       = 0xFFFFFFFFU,
+} esp_ota_img_states_t;
+
+const esp_partition_t *esp_ota_get_running_partition(void);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write_with_offset(esp_ota_handle_t handle, const void *data, size_t size, uint32_t offset);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition);
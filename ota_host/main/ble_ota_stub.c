@@ -0,0 +1,97 @@
+#include <inttypes.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "ota_core.h"
+#include "ble_ota_stub.h"
+
+static const char *TAG = "BLE_OTA_STUB";
+
+#define STUB_SECTOR_SIZE                    4096
+// a sector refused this often in a row ends the replay, as the app gives up
+#define STUB_MAX_RESENDS                    50
+
+static const uint8_t *s_image;
+static uint32_t s_image_len;
+static const bool *s_skip;
+static size_t s_skip_count;
+static uint32_t s_fw_len;       // bytes announced by the start command
+static uint32_t s_dropped;      // sectors refused by a full queue, paced replay
+
+static inline bool
+sector_skipped(uint32_t sector)
+{
+    return s_skip && sector < s_skip_count && s_skip[sector];
+}
+
+void
+ble_ota_stub_load(const uint8_t *image, uint32_t len, const bool *skip, size_t skip_count)
+{
+    s_image = image;
+    s_image_len = len;
+    s_skip = skip;
+    s_skip_count = skip_count;
+    s_fw_len = 0;
+    for (uint32_t off = 0, sector = 0; off < s_image_len; off += STUB_SECTOR_SIZE, sector++) {
+        if (!sector_skipped(sector)) {
+            s_fw_len += MIN(STUB_SECTOR_SIZE, s_image_len - off);
+        }
+    }
+}
+
+esp_err_t
+ble_ota_stub_replay(uint32_t link_kb_s)
+{
+    // one sector's airtime on the link, at least a tick
+    TickType_t slot = link_kb_s ? MAX(1, pdMS_TO_TICKS(STUB_SECTOR_SIZE * 1000 / (link_kb_s * 1024))) : 0;
+    TickType_t last = xTaskGetTickCount();
+
+    s_dropped = 0;
+    for (uint32_t off = 0, sector = 0; off < s_image_len; off += STUB_SECTOR_SIZE, sector++) {
+        size_t len = MIN(STUB_SECTOR_SIZE, s_image_len - off);
+
+        if (sector_skipped(sector)) {
+            continue;
+        }
+        if (!link_kb_s) {
+            // the link never outruns ota_task here: block instead of dropping like ble_ota
+            if (!ota_core_write(s_image + off, len, portMAX_DELAY)) {
+                return ESP_FAIL;
+            }
+            continue;
+        }
+        for (int resends = 0; ; resends++) {
+            vTaskDelayUntil(&last, slot);
+            if (ota_core_write(s_image + off, len, 0)) {
+                break;
+            }
+            s_dropped++;
+            if (resends == STUB_MAX_RESENDS) {
+                ESP_LOGE(TAG, "sector %" PRIu32 " refused %d times", sector, resends + 1);
+                return ESP_ERR_TIMEOUT;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+uint32_t
+ble_ota_stub_dropped(void)
+{
+    return s_dropped;
+}
+
+uint32_t
+esp_ble_ota_get_fw_length(void)
+{
+    return s_fw_len;
+}
+
+void
+esp_ble_ota_send_progress_report(uint8_t percent)
+{
+    ESP_LOGD(TAG, "progress %u%%", percent);
+}
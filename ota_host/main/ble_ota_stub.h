@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+// Host stand-in for ble_ota: the image comes from a file instead of the
+// RECV_FW characteristic and is handed to ota_core in whole 4 KB sectors,
+// as esp_ble_ota_recv_fw_data_callback does on the target.
+
+// Set up a session for `image`; `skip` (may be NULL) marks sectors that are
+// not sent, as under a diff plan. Both must stay valid until the replay ends.
+void ble_ota_stub_load(const uint8_t *image, uint32_t len, const bool *skip, size_t skip_count);
+
+// Feed every sent sector to ota_core. With `link_kb_s` 0 the replay blocks
+// while the queue is full. Otherwise one sector leaves per slot of a link at
+// that many KB/s with no wait, as ota_stream_sector() sends them. A refused
+// sector is counted and resent in the next slot, as after a BUSY ack.
+esp_err_t ble_ota_stub_replay(uint32_t link_kb_s);
+
+// Sectors the queue refused during the last paced replay.
+uint32_t ble_ota_stub_dropped(void);
+
+// Same names as ble_ota's, called from the ota_core hooks.
+uint32_t esp_ble_ota_get_fw_length(void);
+void esp_ble_ota_send_progress_report(uint8_t percent);
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "ota_core.h"
+#include "ble_ota_stub.h"
+
+static const char *TAG = "OTA_HOST";
+
+// Replays a full OTA through ota_core on the linux target, into ota_1 of the
+// emulated flash, and checks the result byte for byte. The default full sink
+// goes through esp_ota_begin/write/end (components/app_update is the host
+// stand-in); CONFIG_OTA_HELPER_SINK_SCRATCH runs the raw sink instead.
+//   OTA_HOST_IMAGE    image to send (default: the blink build)
+//   OTA_HOST_RUNNING  optional image put in ota_0 first; unchanged sectors
+//                     are then copied from it as under a sector diff plan
+//   OTA_HOST_LINK_KB_S  optional link rate in KB/s: sectors are paced to it and
+//                     sent without waiting, refused ones are reported
+#define DEFAULT_IMAGE                       "../ble_ota_blink/build/ble_ota_blink.bin"
+#define HOST_RINGBUF_SIZE                   8192
+#define HOST_SECTOR_SIZE                    4096
+
+static SemaphoreHandle_t s_done;
+static esp_err_t s_result = ESP_FAIL;
+static bool *s_unchanged;
+static size_t s_sector_count;
+static uint32_t s_plan_len;
+
+static uint8_t *
+read_file(const char *path, uint32_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+
+    if (!f) {
+        ESP_LOGE(TAG, "cannot open %s", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > 0 && (buf = malloc(size)) && fread(buf, 1, size, f) == (size_t)size) {
+        *len = size;
+    } else {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    return buf;
+}
+
+static double
+now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* ------------------------------ ota_core hooks ----------------------------------- */
+static uint32_t
+host_plan_image_len(void)
+{
+    return s_plan_len;
+}
+
+static bool
+host_sector_unchanged(uint16_t sector)
+{
+    return sector < s_sector_count && s_unchanged[sector];
+}
+
+static void
+host_finished(esp_err_t err)
+{
+    s_result = err;
+    xSemaphoreGive(s_done);
+}
+
+static const ota_core_hooks_t s_hooks = {
+    .fw_length = esp_ble_ota_get_fw_length,
+    .progress = esp_ble_ota_send_progress_report,
+    .plan_image_len = host_plan_image_len,
+    .sector_unchanged = host_sector_unchanged,
+    .finished = host_finished,
+};
+
+// ota_0 gets the "running" image; sectors equal in both images form the plan
+static esp_err_t
+prepare_diff(const uint8_t *image, uint32_t image_len, const char *running_path)
+{
+    const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    uint32_t running_len = 0;
+    uint8_t *running = read_file(running_path, &running_len);
+    esp_err_t err = ESP_FAIL;
+
+    if (!ota_0 || !running || running_len > ota_0->size) {
+        goto DONE;
+    }
+    uint32_t erase_len = (running_len + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE * HOST_SECTOR_SIZE;
+    if ((err = esp_partition_erase_range(ota_0, 0, erase_len)) != ESP_OK ||
+        (err = esp_partition_write(ota_0, 0, running, running_len)) != ESP_OK) {
+        goto DONE;
+    }
+
+    s_sector_count = (image_len + HOST_SECTOR_SIZE - 1) / HOST_SECTOR_SIZE;
+    s_unchanged = calloc(s_sector_count, sizeof(bool));
+    if (!s_unchanged) {
+        err = ESP_ERR_NO_MEM;
+        goto DONE;
+    }
+    size_t same = 0;
+    for (size_t s = 0; s < s_sector_count; s++) {
+        uint32_t off = s * HOST_SECTOR_SIZE;
+        uint32_t len = MIN(HOST_SECTOR_SIZE, image_len - off);
+        s_unchanged[s] = off + len <= running_len && memcmp(image + off, running + off, len) == 0;
+        same += s_unchanged[s];
+    }
+    s_plan_len = image_len;
+    printf("diff plan: %zu of %zu sectors unchanged\n", same, s_sector_count);
+
+DONE:
+    free(running);
+    return err;
+}
+
+static bool
+verify(const uint8_t *image, uint32_t image_len)
+{
+    const esp_partition_t *ota_1 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, NULL);
+    static uint8_t buf[HOST_SECTOR_SIZE];
+
+    for (uint32_t off = 0; off < image_len; off += HOST_SECTOR_SIZE) {
+        uint32_t len = MIN(HOST_SECTOR_SIZE, image_len - off);
+        if (esp_partition_read(ota_1, off, buf, len) != ESP_OK || memcmp(buf, image + off, len) != 0) {
+            printf("mismatch in sector %" PRIu32 "\n", off / HOST_SECTOR_SIZE);
+            return false;
+        }
+    }
+    return true;
+}
+
+void app_main(void)
+{
+    const char *image_path = getenv("OTA_HOST_IMAGE") ? getenv("OTA_HOST_IMAGE") : DEFAULT_IMAGE;
+    const char *running_path = getenv("OTA_HOST_RUNNING");
+    uint32_t link_kb_s = getenv("OTA_HOST_LINK_KB_S") ? strtoul(getenv("OTA_HOST_LINK_KB_S"), NULL, 10) : 0;
+    uint32_t image_len = 0;
+    uint8_t *image = read_file(image_path, &image_len);
+
+    if (!image) {
+        exit(2);
+    }
+    if (running_path && prepare_diff(image, image_len, running_path) != ESP_OK) {
+        ESP_LOGE(TAG, "cannot prepare diff against %s", running_path);
+        exit(2);
+    }
+    s_done = xSemaphoreCreateBinary();
+    if (!s_done || !ota_core_init(HOST_RINGBUF_SIZE, &s_hooks)) {
+        exit(2);
+    }
+
+    ble_ota_stub_load(image, image_len, s_unchanged, s_sector_count);
+    double t0 = now_ms();
+    if (!ota_core_start() || ble_ota_stub_replay(link_kb_s) != ESP_OK) {
+        ESP_LOGE(TAG, "replay failed");
+        exit(1);
+    }
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    double elapsed = now_ms() - t0;
+
+    bool ok = s_result == ESP_OK && verify(image, image_len);
+    printf("%s: %" PRIu32 " bytes (%" PRIu32 " sent) in %.1f ms, %.1f MB/s -> %s\n", image_path, image_len,
+           esp_ble_ota_get_fw_length(), elapsed, image_len / 1048576.0 / (elapsed / 1000.0), ok ? "OK" : "FAIL");
+    if (link_kb_s) {
+        printf("paced at %" PRIu32 " KB/s: %" PRIu32 " sectors refused by a full queue and resent\n",
+               link_kb_s, ble_ota_stub_dropped());
+    }
+    exit(ok ? 0 : 1);
+}
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "psa/crypto.h"
+#include "xz.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#endif
+
+static const char *TAG = "OTA_KBENCH";
+
+// Times the kernels an OTA sector goes through, one 4 KB sector at a time:
+//   crc16    ble_ota framing (bit-serial as in ble_ota / ota_relay, table, ROM)
+//   crc32    candidate framing checksum (table, ROM)
+//   sha256   esp_ota_end image check and the sector diff hashes (PSA)
+//   aes-gcm  esp_encrypted_img payload (PSA, AES-256-GCM)
+//   xz       gen_custom_ota.py images (xz-embedded, 64 KB dictionary)
+// SHA-256 and AES-GCM use whatever mbedTLS was built with; build once more
+// with sdkconfig.sw for the software numbers.
+#define KBENCH_SECTOR_SIZE                  4096
+#define KBENCH_ITERATIONS                   256
+#define KBENCH_XZ_ITERATIONS                8
+#define KBENCH_XZ_DICT_MAX                  (64 * 1024)
+
+extern const uint8_t xz_sample_start[] asm("_binary_sample_bin_xz_start");
+extern const uint8_t xz_sample_end[] asm("_binary_sample_bin_xz_end");
+
+typedef uint32_t (*kernel_fn_t)(const uint8_t *in, size_t len);
+
+typedef struct {
+    const char *name;
+    const char *impl;
+    kernel_fn_t fn;
+} kernel_t;
+
+static uint8_t s_sector[KBENCH_SECTOR_SIZE];
+static uint8_t s_out[KBENCH_SECTOR_SIZE + 16];
+static uint16_t s_crc16_table[256];
+static uint32_t s_crc32_table[256];
+static psa_key_id_t s_aes_key;
+
+/* ------------------------------ clocks ------------------------------------------- */
+static int64_t
+now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static inline uint32_t
+cycles_now(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 0;
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+/* ------------------------------ kernels ------------------------------------------ */
+// CRC16-CCITT, init 0, no final xor: what ble_ota checks per sector
+static uint32_t
+crc16_bitwise(const uint8_t *in, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)in[i] << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static uint32_t
+crc16_table(const uint8_t *in, size_t len)
+{
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 8) ^ s_crc16_table[(crc >> 8) ^ in[i]];
+    }
+    return crc;
+}
+
+// the ROM variant inverts on the way in and out, undo both for the ble_ota flavour
+static uint32_t
+crc16_rom(const uint8_t *in, size_t len)
+{
+    return (uint16_t)~esp_rom_crc16_be((uint16_t)~0, in, len);
+}
+
+// IEEE 802.3, reflected, as zlib's crc32()
+static uint32_t
+crc32_table(const uint8_t *in, size_t len)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 8) ^ s_crc32_table[(crc ^ in[i]) & 0xff];
+    }
+    return ~crc;
+}
+
+static uint32_t
+crc32_rom(const uint8_t *in, size_t len)
+{
+    return esp_rom_crc32_le(0, in, len);
+}
+
+static uint32_t
+sha256_psa(const uint8_t *in, size_t len)
+{
+    size_t hash_len = 0;
+    if (psa_hash_compute(PSA_ALG_SHA_256, in, len, s_out, 32, &hash_len) != PSA_SUCCESS) {
+        abort();
+    }
+    return s_out[0];
+}
+
+static uint32_t
+aes_gcm_psa(const uint8_t *in, size_t len)
+{
+    static const uint8_t nonce[12] = { 0 };
+    size_t out_len = 0;
+    if (psa_aead_encrypt(s_aes_key, PSA_ALG_GCM, nonce, sizeof(nonce), NULL, 0, in, len, s_out, sizeof(s_out),
+                         &out_len) != PSA_SUCCESS) {
+        abort();
+    }
+    return s_out[0];
+}
+
+static void
+tables_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint16_t c16 = i << 8;
+        uint32_t c32 = i;
+        for (int j = 0; j < 8; j++) {
+            c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : c16 << 1;
+            c32 = (c32 & 1) ? (c32 >> 1) ^ 0xedb88320 : c32 >> 1;
+        }
+        s_crc16_table[i] = c16;
+        s_crc32_table[i] = c32;
+    }
+}
+
+static bool
+crypto_init(void)
+{
+    static const uint8_t key[32] = { 0x42 };
+    psa_key_attributes_t attr = PSA_KEY_ATTRIBUTES_INIT;
+
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        return false;
+    }
+    psa_set_key_type(&attr, PSA_KEY_TYPE_AES);
+    psa_set_key_bits(&attr, 256);
+    psa_set_key_usage_flags(&attr, PSA_KEY_USAGE_ENCRYPT);
+    psa_set_key_algorithm(&attr, PSA_ALG_GCM);
+    return psa_import_key(&attr, key, sizeof(key), &s_aes_key) == PSA_SUCCESS;
+}
+
+/* ------------------------------ runner ------------------------------------------- */
+static void
+report(const char *name, const char *impl, double us, double cycles)
+{
+    printf("%-8s %-8s %10.1f %12.0f %9.2f\n", name, impl, us, cycles, KBENCH_SECTOR_SIZE / us);
+}
+
+static void
+run_kernel(const kernel_t *k)
+{
+    volatile uint32_t sink = 0;
+
+    // warm the cache and any lazily set up engine first
+    sink ^= k->fn(s_sector, sizeof(s_sector));
+
+    int64_t t0 = now_us();
+    uint32_t c0 = cycles_now();
+    for (int i = 0; i < KBENCH_ITERATIONS; i++) {
+        sink ^= k->fn(s_sector, sizeof(s_sector));
+    }
+    uint32_t cycles = cycles_now() - c0;
+    int64_t us = now_us() - t0;
+
+    report(k->name, k->impl, (double)us / KBENCH_ITERATIONS, (double)cycles / KBENCH_ITERATIONS);
+    (void)sink;
+}
+
+// whole-sample decodes, reported per 4 KB of output
+static void
+run_xz(void)
+{
+    size_t in_len = xz_sample_end - xz_sample_start;
+    uint8_t *out = malloc(KBENCH_SECTOR_SIZE);
+    struct xz_dec *dec = xz_dec_init(XZ_DYNALLOC, KBENCH_XZ_DICT_MAX);
+    size_t out_total = 0;
+
+    if (!out || !dec) {
+        ESP_LOGE(TAG, "xz: no memory");
+        goto DONE;
+    }
+    int64_t t0 = now_us();
+    uint32_t c0 = cycles_now();
+    for (int i = 0; i < KBENCH_XZ_ITERATIONS; i++) {
+        struct xz_buf b = { .in = xz_sample_start, .in_size = in_len, .out = out, .out_size = KBENCH_SECTOR_SIZE };
+        enum xz_ret ret;
+
+        xz_dec_reset(dec);
+        do {
+            b.out_pos = 0;
+            ret = xz_dec_run(dec, &b);
+            out_total += b.out_pos;
+        } while (ret == XZ_OK);
+        if (ret != XZ_STREAM_END) {
+            ESP_LOGE(TAG, "xz: decode failed (%d)", ret);
+            goto DONE;
+        }
+    }
+    uint32_t cycles = cycles_now() - c0;
+    int64_t us = now_us() - t0;
+
+    double sectors = (double)out_total / KBENCH_SECTOR_SIZE;
+    report("xz", "sw", us / sectors, cycles / sectors);
+    printf("xz sample: %zu -> %zu bytes\n", in_len, out_total / KBENCH_XZ_ITERATIONS);
+
+DONE:
+    if (dec) {
+        xz_dec_end(dec);
+    }
+    free(out);
+}
+
+void app_main(void)
+{
+#if CONFIG_MBEDTLS_HARDWARE_SHA
+    const char *sha_impl = "hw";
+#else
+    const char *sha_impl = "sw";
+#endif
+#if CONFIG_MBEDTLS_HARDWARE_AES
+    const char *aes_impl = "hw";
+#else
+    const char *aes_impl = "sw";
+#endif
+    const kernel_t kernels[] = {
+        { "crc16", "bitwise", crc16_bitwise },
+        { "crc16", "table", crc16_table },
+        { "crc16", "rom", crc16_rom },
+        { "crc32", "table", crc32_table },
+        { "crc32", "rom", crc32_rom },
+        { "sha256", sha_impl, sha256_psa },
+        { "aes-gcm", aes_impl, aes_gcm_psa },
+    };
+
+    // firmware-like bytes, the checksums do not care but the decoders would
+    for (size_t i = 0; i < sizeof(s_sector); i++) {
+        s_sector[i] = (i * 2654435761u) >> 24;
+    }
+    tables_init();
+    xz_crc32_init();
+    if (!crypto_init()) {
+        ESP_LOGE(TAG, "PSA crypto init failed");
+        exit(1);
+    }
+    // the table and ROM variants must agree with the reference before they are timed
+    if (crc16_table(s_sector, sizeof(s_sector)) != crc16_bitwise(s_sector, sizeof(s_sector)) ||
+        crc16_rom(s_sector, sizeof(s_sector)) != crc16_bitwise(s_sector, sizeof(s_sector)) ||
+        crc32_rom(s_sector, sizeof(s_sector)) != crc32_table(s_sector, sizeof(s_sector))) {
+        ESP_LOGE(TAG, "CRC variants disagree");
+        exit(1);
+    }
+
+#if CONFIG_IDF_TARGET_LINUX
+    printf("host build: cycles not available\n");
+#else
+    printf("%s @ %d MHz\n", CONFIG_IDF_TARGET, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+#endif
+    printf("kernel   impl      us/sector cycles/sect.      MB/s\n");
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        run_kernel(&kernels[i]);
+        // let the idle task run between kernels
+        vTaskDelay(1);
+    }
+    run_xz();
+
+#if CONFIG_IDF_TARGET_LINUX
+    exit(0);
+#endif
+}
@@ -0,0 +1,12 @@
+#!/usr/bin/env python
+# Compress the first 64 KB of an app image with gen_custom_ota.py's xz settings.
+import lzma
+import sys
+
+SAMPLE_SIZE = 64 * 1024
+FILTERS = [{'id': lzma.FILTER_LZMA2, 'preset': 6, 'dict_size': 64 * 1024}]
+
+with open(sys.argv[1], 'rb') as f:
+    data = f.read(SAMPLE_SIZE)
+with open(sys.argv[2], 'wb') as f:
+    f.write(lzma.compress(data, format=lzma.FORMAT_XZ, check=lzma.CHECK_CRC32, filters=FILTERS))
@@ -0,0 +1,4 @@
+# Software-only mbedTLS, for the "sw" column of SHA-256 and AES-GCM:
+# idf.py -B build_sw -D SDKCONFIG=build_sw/sdkconfig -D SDKCONFIG_DEFAULTS="sdkconfig.defaults;sdkconfig.sw" build
+CONFIG_MBEDTLS_HARDWARE_AES=n
+CONFIG_MBEDTLS_HARDWARE_SHA=n
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Compare the OTA_BENCH session summaries of two device logs.
+
+    python3 scripts/compareOtaBench.py default.log perf.log
+
+Each log is `idf.py monitor` output from a firmware built with
+CONFIG_OTA_HELPER_BENCH_REPORT, e.g. the default profile and sdkconfig.perf,
+over the same transfer. Metrics are averaged over the successful sessions
+of each log and printed side by side with the relative change.
+"""
+import argparse
+import re
+import sys
+
+PATTERNS = {
+    "recv_kbps": (r"throughput ([\d.]+) KB/s received", "received KB/s"),
+    "write_kbps": (r"throughput [\d.]+ KB/s received, ([\d.]+) KB/s written", "written KB/s"),
+    "wait_avg": (r"per sector: wait ([\d.]+) ms avg", "wait ms/sector avg"),
+    "wait_max": (r"per sector: wait [\d.]+ ms avg / ([\d.]+) max", "wait ms/sector max"),
+    "write_avg": (r"write ([\d.]+) ms avg", "write ms/sector avg"),
+    "write_max": (r"write [\d.]+ ms avg / ([\d.]+) max", "write ms/sector max"),
+    "seconds": (r"B copied in ([\d.]+) s", "session s"),
+}
+SESSION_RE = re.compile(r"OTA_BENCH: sink (\w+), (\S+): ")
+CORE_RE = re.compile(r"OTA_BENCH: core (\d+) load ([\d.]+)%")
+
+
+def parse(path):
+    """One dict per successful session, in log order."""
+    sessions, cur = [], None
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            if "OTA_BENCH" not in line:
+                continue
+            m = SESSION_RE.search(line)
+            if m:
+                cur = {"sink": m.group(1)} if m.group(2) == "ok" else None
+                if cur is not None:
+                    sessions.append(cur)
+            if cur is None:
+                continue
+            for key, (pattern, _) in PATTERNS.items():
+                m = re.search(pattern, line)
+                if m:
+                    cur[key] = float(m.group(1))
+            m = CORE_RE.search(line)
+            if m:
+                cur[f"core{m.group(1)}"] = float(m.group(2))
+    if not sessions:
+        sys.exit(f"{path}: no successful OTA_BENCH session")
+    return sessions
+
+
+def mean(sessions, key):
+    values = [s[key] for s in sessions if key in s]
+    return sum(values) / len(values) if values else None
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("baseline")
+    ap.add_argument("candidate")
+    args = ap.parse_args()
+
+    a, b = parse(args.baseline), parse(args.candidate)
+    sinks = {s["sink"] for s in a + b}
+    if len(sinks) > 1:
+        print(f"warning: logs mix sinks {sorted(sinks)}, numbers are not comparable", file=sys.stderr)
+
+    labels = {key: label for key, (_, label) in PATTERNS.items()}
+    cores = sorted({k for s in a + b for k in s if k.startswith("core")})
+    labels.update({c: f"{c} load %" for c in cores})
+
+    print(f"{'':22}{'baseline':>12}{'candidate':>12}{'change':>10}")
+    print(f"{'sessions':22}{len(a):>12}{len(b):>12}")
+    for key, label in labels.items():
+        x, y = mean(a, key), mean(b, key)
+        if x is None and y is None:
+            continue
+        fmt = lambda v: f"{v:12.2f}" if v is not None else f"{'-':>12}"
+        change = f"{(y - x) / x * 100:+9.1f}%" if x and y is not None else ""
+        print(f"{label:22}{fmt(x)}{fmt(y)}{change}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,96 @@
+/*
+ * OTA throughput benchmark against the in-process ESP32 simulator.
+ *
+ *   npx tsx scripts/otaBench.ts [--image firmware.bin] [--size 262144]
+ *                               [--loss 0.001] [--flash-ms 25]
+ *                               [--sink full|scratch|discard] [--crc crc16|crc32]
+ *
+ * Runs runOtaTransfer() end to end for every MTU x window x link latency
+ * combination below and prints one row per run. No phone or board needed.
+ * --sink discard takes flash out of the loop to show the link ceiling, as a
+ * device built with CONFIG_OTA_HELPER_SINK_DISCARD does.
+ */
+/* ----------------------------- Imports ----------------------------------------- */
+import { readFileSync } from 'fs';
+import { Buffer } from 'buffer';
+import { runOtaTransfer } from '../otaTransfer';
+import { OtaSimulatorSink, SimulatedOtaDevice } from '../otaSimulator';
+
+/* ----------------------------- Constants ---------------------------------------- */
+const MTUS = [185, 247, 517];
+const WINDOWS = [1, 2];
+const WRITE_LATENCIES_MS = [7.5, 15, 30];
+
+/* ----------------------------- helper functions --------------------------------- */
+function arg(name: string): string | undefined {
+  const i = process.argv.indexOf(`--${name}`);
+  return i >= 0 ? process.argv[i + 1] : undefined;
+}
+
+function loadImage(): Buffer {
+  const path = arg('image');
+  if (path) return Buffer.from(readFileSync(path));
+  const size = Number(arg('size') ?? 256 * 1024);
+  const image = Buffer.alloc(size);
+  for (let i = 0; i < size; i++) image[i] = (i * 2654435761) >>> 24;
+  return image;
+}
+
+/* ----------------------------- main --------------------------------------------- */
+async function main() {
+  const image = loadImage();
+  const packetLoss = Number(arg('loss') ?? 0);
+  const flashWriteLatencyMs = Number(arg('flash-ms') ?? 25);
+  const sink = (arg('sink') ?? 'full') as OtaSimulatorSink;
+  const crc32 = arg('crc') === 'crc32';
+  if (!['full', 'scratch', 'discard'].includes(sink)) {
+    console.error(`unknown sink ${sink}, ${crc32 ? 'crc32' : 'crc16'}`);
+    process.exit(2);
+  }
+
+  // the transfer loop logs every sector; keep the table readable
+  const log = console.log;
+  console.log = () => {};
+  console.warn = () => {};
+  console.error = () => {};
+
+  log(`image ${image.length} bytes, loss ${packetLoss}, flash ${flashWriteLatencyMs} ms/sector, sink ${sink}`);
+  log('mtu  chunk  window  lat(ms)  time(s)    KB/s  resent  lost  dropped  ok');
+
+  for (const mtu of MTUS) {
+    for (const window of WINDOWS) {
+      for (const writeLatencyMs of WRITE_LATENCIES_MS) {
+        const chunkSize = mtu - 8; // ATT header 3 + sector header 3 + CRC16 2
+        const sim = new SimulatedOtaDevice({ mtu, writeLatencyMs, flashWriteLatencyMs, packetLoss, sink });
+        let ok: boolean | undefined = false;
+        let seconds = NaN;
+        let resent = 0;
+        try {
+          const result = await runOtaTransfer(sim, image, { chunkSize, window, crc32 });
+          // nothing to compare once the sink dropped the image
+          ok = sink === 'discard' ? undefined : sim.verify(image);
+          seconds = result.elapsedMs / 1000;
+          resent = result.retransmits;
+        } catch (e) {
+          ok = false;
+        }
+        log(
+          [
+            String(mtu).padEnd(4),
+            String(chunkSize).padStart(5),
+            String(window).padStart(7),
+            String(writeLatencyMs).padStart(8),
+            seconds.toFixed(2).padStart(8),
+            (image.length / 1024 / seconds).toFixed(1).padStart(7),
+            String(resent).padStart(7),
+            String(sim.stats.lostPackets).padStart(5),
+            String(sim.stats.droppedSectors).padStart(8),
+            ok === undefined ? ' n/a' : ok ? ' yes' : '  NO',
+          ].join(' ')
+        );
+      }
+    }
+  }
+}
+
+main();
@@ -0,0 +1,29 @@
+# Image size budget for an ESP-IDF app, included after project():
+#   idf.py ota-size            per-component sizes and deltas vs the baseline,
+#                              with the OTA seconds they cost
+#   idf.py ota-size-baseline   store the current build as the new baseline
+# OTA_SIZE_KBPS lists the link throughputs (KB/s) the estimate is made for,
+# e.g. the BLE and Wi-Fi rates otaBench.ts reports for the target board.
+set(OTA_SIZE_KBPS "5;10;20;40" CACHE STRING "link throughputs for the OTA time estimate, KB/s")
+set(OTA_SIZE_MAX_GROWTH 0 CACHE STRING "fail ota-size when the image grew by more bytes (0 = report only)")
+set(OTA_SIZE_BASELINE "${CMAKE_SOURCE_DIR}/ota_size_baseline.json" CACHE FILEPATH "stored size baseline")
+
+idf_build_get_property(python PYTHON)
+string(REPLACE ";" "," ota_size_kbps "${OTA_SIZE_KBPS}")
+set(ota_size_cmd ${python} "${CMAKE_CURRENT_LIST_DIR}/otaSizeBudget.py"
+    --map "${CMAKE_BINARY_DIR}/${PROJECT_NAME}.map"
+    --bin "${CMAKE_BINARY_DIR}/${PROJECT_NAME}.bin"
+    --baseline "${OTA_SIZE_BASELINE}")
+
+add_custom_target(ota-size
+    COMMAND ${ota_size_cmd} --kbps ${ota_size_kbps} --max-growth ${OTA_SIZE_MAX_GROWTH}
+    USES_TERMINAL
+    VERBATIM
+)
+add_custom_target(ota-size-baseline
+    COMMAND ${ota_size_cmd} --update-baseline
+    USES_TERMINAL
+    VERBATIM
+)
+add_dependencies(ota-size app)
+add_dependencies(ota-size-baseline app)
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""Per-component image size against a stored baseline, in OTA seconds.
+
+    python3 scripts/otaSizeBudget.py --map build/app.map [--bin build/app.bin]
+        [--baseline ota_size_baseline.json] [--kbps 5,10,20,40]
+        [--max-growth 0] [--update-baseline] [--top 25]
+
+Parses the GNU ld map of an ESP-IDF app and sums, per component (static
+library), the input sections that end up in the flashed image: flash text
+and rodata, IRAM, DRAM data and RTC data. bss/noinit and debug sections do
+not cross the link and are ignored. Sizes are compared with the baseline
+and converted into transfer seconds at the given link throughputs (KB/s of
+image payload), so a 50 KB component is read as the seconds it adds to
+every update.
+
+Run as `idf.py ota-size` / `idf.py ota-size-baseline` (see otaSize.cmake).
+"""
+import argparse
+import json
+import os
+import re
+import sys
+
+# output sections whose contents are part of the .bin
+LOADED_SECTION_RE = re.compile(
+    r"^\.(rtc\.(text|data|force_fast|force_slow)|iram0\.(vectors|text|data)|dram0\.data|"
+    r"flash\.(text|appdesc|rodata|init_array|tdata))$"
+)
+OUTPUT_SECTION_RE = re.compile(r"^(\.\S+)")
+# " .text.foo  0xADDR  0xSIZE file", the name may sit alone on the line before
+INPUT_SECTION_RE = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+(.*))?$")
+INPUT_NAME_RE = re.compile(r"^ (\.\S+)$")
+RELAXED_RE = re.compile(r"^\s+0x([0-9a-f]+) \(size before relaxing\)$")
+ARCHIVE_RE = re.compile(r"lib([^/\\]+)\.a\(")
+
+
+def component_of(origin):
+    if not origin:
+        return "(alignment)"
+    m = ARCHIVE_RE.search(origin)
+    if m:
+        return m.group(1)
+    if "linker stubs" in origin:
+        return "(linker)"
+    return "(app objects)"
+
+
+class StringPool:
+    """Mergeable string sections (.str1.*) of one output section.
+
+    ld merges them into one blob listed under the first object and shows the
+    other contributors at addresses inside or right after it, so addresses
+    say nothing about who owns what. The bytes they cover are counted once
+    and split by the unmerged sizes.
+    """
+
+    def __init__(self):
+        self.bytes = 0
+        self.weights = {}
+        self.last = None
+
+    def add(self, comp, fresh, size):
+        self.bytes += fresh
+        self.weights[comp] = self.weights.get(comp, 0) + size
+        self.last = (comp, size)
+
+    def relaxed(self, size):
+        comp, listed = self.last
+        self.weights[comp] += size - listed
+        self.last = None
+
+    def flush(self, sizes):
+        total = sum(self.weights.values())
+        for comp, w in self.weights.items():
+            sizes[comp] = sizes.get(comp, 0) + self.bytes * w / total
+        self.__init__()
+
+
+def parse_map(path):
+    sizes = {}
+    in_memory_map = False
+    loaded = False
+    name = None
+    strings = StringPool()
+    covered = 0
+    with open(path, encoding="utf-8", errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if not in_memory_map:
+                in_memory_map = line.startswith("Linker script and memory map")
+                continue
+            m = OUTPUT_SECTION_RE.match(line)
+            if m:
+                strings.flush(sizes)
+                loaded = bool(LOADED_SECTION_RE.match(m.group(1)))
+                covered = 0
+                continue
+            if not loaded:
+                continue
+            m = INPUT_NAME_RE.match(line)
+            if m:
+                name = m.group(1)
+                continue
+            m = RELAXED_RE.match(line)
+            if m:
+                if strings.last:
+                    strings.relaxed(int(m.group(1), 16))
+                continue
+            m = INPUT_SECTION_RE.match(line)
+            if not m:
+                continue
+            name, addr, size = m.group(1) or name, int(m.group(2), 16), int(m.group(3), 16)
+            comp = component_of(m.group(4))
+            # overlapping bytes are already counted
+            fresh = max(0, addr + size - max(addr, covered))
+            covered = max(covered, addr + size)
+            strings.last = None
+            if name and ".str1." in name:
+                strings.add(comp, fresh, size)
+            elif fresh:
+                sizes[comp] = sizes.get(comp, 0) + fresh
+            name = None
+    strings.flush(sizes)
+    if not in_memory_map:
+        sys.exit(f"{path}: no memory map, is this a GNU ld map file?")
+    return {comp: round(n) for comp, n in sizes.items() if round(n)}
+
+
+def seconds(nbytes, kbps):
+    return nbytes / 1024 / kbps
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--map", required=True)
+    ap.add_argument("--bin", help="flashed image; its size is used for the total")
+    ap.add_argument("--baseline", help="JSON written by --update-baseline")
+    ap.add_argument("--kbps", default="5,10,20,40", help="link throughputs, KB/s (comma or ; separated)")
+    ap.add_argument("--max-growth", type=int, default=0,
+                    help="fail when the image grew by more bytes than this over the baseline (0 = report only)")
+    ap.add_argument("--update-baseline", action="store_true")
+    ap.add_argument("--top", type=int, default=25, help="largest components listed (changed ones always are)")
+    args = ap.parse_args()
+
+    sizes = parse_map(args.map)
+    image = os.path.getsize(args.bin) if args.bin else sum(sizes.values())
+    rates = [float(r) for r in re.split(r"[,;]", args.kbps) if r]
+
+    if args.update_baseline:
+        if not args.baseline:
+            sys.exit("--update-baseline needs --baseline")
+        with open(args.baseline, "w", encoding="utf-8") as f:
+            json.dump({"image_bytes": image, "components": dict(sorted(sizes.items()))}, f, indent=2)
+            f.write("\n")
+        print(f"baseline written: {args.baseline} ({image} bytes)")
+        return
+
+    base = {"image_bytes": None, "components": {}}
+    if args.baseline and os.path.exists(args.baseline):
+        with open(args.baseline, encoding="utf-8") as f:
+            base = json.load(f)
+    elif args.baseline:
+        print(f"no baseline at {args.baseline}, sizes only", file=sys.stderr)
+    base_sizes = base["components"]
+    base_image = base["image_bytes"]
+
+    names = set(sizes) | set(base_sizes)
+    delta = {n: sizes.get(n, 0) - base_sizes.get(n, 0) for n in names}
+    ranked = sorted(names, key=lambda n: -sizes.get(n, 0))
+    shown = [n for i, n in enumerate(ranked) if i < args.top or (base_sizes and delta[n])]
+
+    rate_cols = "".join(f"{f'{r:g} KB/s':>11}" for r in rates)
+    print(f"{'component':32}{'bytes':>10}{'delta':>10}{rate_cols}")
+    for n in shown:
+        d = f"{delta[n]:+10d}" if base_sizes else f"{'':>10}"
+        cost = "".join(f"{seconds(sizes.get(n, 0), r):10.1f}s" for r in rates)
+        print(f"{n[:31]:32}{sizes.get(n, 0):10d}{d}{cost}")
+    if len(shown) < len(ranked):
+        rest = sum(sizes.get(n, 0) for n in ranked if n not in shown)
+        print(f"{f'({len(ranked) - len(shown)} more)':32}{rest:10d}")
+
+    print()
+    d = f"{image - base_image:+10d}" if base_image else f"{'':>10}"
+    print(f"{'image':32}{image:10d}{d}" + "".join(f"{seconds(image, r):10.1f}s" for r in rates))
+    if base_image:
+        grew = image - base_image
+        print(f"{'OTA time change':32}{'':20}" + "".join(f"{seconds(grew, r):+10.1f}s" for r in rates))
+        if args.max_growth and grew > args.max_growth:
+            sys.exit(f"image grew by {grew} bytes, budget is {args.max_growth}")
+
+
+if __name__ == "__main__":
+    main()
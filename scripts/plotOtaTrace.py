@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Plot OTA session traces exported by the app (ota-traces/*.json).
+
+    python3 scripts/plotOtaTrace.py trace1.json [trace2.json ...] [-o out.png]
+
+Draws, per trace: confirmed bytes over time (throughput), per-sector send
+time (first write to last write) and per-sector ack latency (last write to
+progress confirmation). Several traces are overlaid for comparison across
+phones, app builds or firmware builds.
+"""
+import argparse
+import json
+import os
+import sys
+
+
+def load(path):
+    with open(path, encoding="utf-8") as f:
+        trace = json.load(f)
+    if trace.get("version") != 1:
+        sys.exit(f"{path}: unsupported trace version {trace.get('version')}")
+    names = trace["events"]
+    events = [(t, names[k], sector, value) for t, k, sector, value in trace["timeline"]]
+    return trace, events
+
+
+def sector_timings(events):
+    send_start, send_end, sizes = {}, {}, {}
+    send_ms, ack_ms = [], []
+    for t, name, sector, value in events:
+        if name == "sector_send_start":
+            send_start[sector] = t
+        elif name == "sector_send_end":
+            send_end[sector] = t
+            sizes[sector] = value
+            if sector in send_start:
+                send_ms.append((sector, t - send_start[sector]))
+        elif name == "sector_ack" and sector in send_end:
+            ack_ms.append((sector, t - send_end[sector]))
+    return send_ms, ack_ms, sizes
+
+
+def throughput_curve(events, sizes):
+    xs, ys, total = [0.0], [0.0], 0
+    for t, name, sector, _ in events:
+        if name == "sector_ack":
+            total += sizes.get(sector, 4096)
+            xs.append(t / 1000.0)
+            ys.append(total / 1024.0)
+    return xs, ys
+
+
+def summary(path, trace, events, ys, xs):
+    meta = trace["meta"]
+    dur = xs[-1] if len(xs) > 1 else 0.0
+    rate = ys[-1] / dur if dur > 0 else 0.0
+    counts = {}
+    for _, name, _, _ in events:
+        counts[name] = counts.get(name, 0) + 1
+    print(
+        f"{os.path.basename(path)}: {meta.get('deviceName')} {meta.get('platform')} "
+        f"{meta.get('osVersion')} mtu={meta.get('mtu')} chunk={meta.get('chunkSize')} "
+        f"window={meta.get('window')} priority={meta.get('connPriority')} "
+        f"itvl={meta.get('connIntervalMs')}ms phy={meta.get('connPhy')} -> {ys[-1]:.0f} KB in {dur:.1f} s = {rate:.1f} KB/s, "
+        f"nacks={counts.get('sector_nack', 0)} rewinds={counts.get('rewind', 0)} "
+        f"errors={len(trace['errors'])} complete={'complete' in counts}"
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("traces", nargs="+")
+    parser.add_argument("-o", "--output", help="write the figure to a file instead of showing it")
+    args = parser.parse_args()
+
+    try:
+        import matplotlib
+        if args.output:
+            matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        sys.exit("matplotlib is required: pip install matplotlib")
+
+    fig, (ax_tp, ax_send, ax_ack) = plt.subplots(3, 1, figsize=(10, 11))
+    for path in args.traces:
+        trace, events = load(path)
+        send_ms, ack_ms, sizes = sector_timings(events)
+        xs, ys = throughput_curve(events, sizes)
+        summary(path, trace, events, ys, xs)
+
+        label = os.path.basename(path)
+        ax_tp.step(xs, ys, where="post", label=label)
+        if send_ms:
+            ax_send.plot(*zip(*send_ms), ".", label=label)
+        if ack_ms:
+            ax_ack.plot(*zip(*ack_ms), ".", label=label)
+
+    ax_tp.set(title="Confirmed data", xlabel="time (s)", ylabel="KB")
+    ax_send.set(title="Sector send time (first to last write)", xlabel="sector", ylabel="ms")
+    ax_ack.set(title="Sector ack latency (last write to progress)", xlabel="sector", ylabel="ms")
+    for ax in (ax_tp, ax_send, ax_ack):
+        ax.grid(True, alpha=0.3)
+        ax.legend(fontsize="small")
+    fig.tight_layout()
+
+    if args.output:
+        fig.savefig(args.output, dpi=120)
+        print(f"saved {args.output}")
+    else:
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()